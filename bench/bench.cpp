@@ -0,0 +1,438 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//
+// Microbenchmarks, reported as JSON on stdout.  Each benchmark is run until
+// it has taken a minimum time, which is 200ms unless given in milliseconds as
+// the first argument.  A second argument selects the benchmarks whose names
+// contain it.
+//
+// For each benchmark, the report gives the mean nanoseconds, allocations (by
+// operator new) and output bytes per operation.  For the refresh benchmarks an
+// operation is a frame, written to the headless virtual terminal.  For the line
+// scans it is a scan of 16MB of text, and the bytes are those scanned.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vitapi.h>
+#include <screen.h>
+#include <lines.h>
+
+#define WIDTH  200               // Virtual terminal size for frames
+#define HEIGHT 60
+
+static std::atomic <size_t> allocations (0);
+
+////////////////////////////////////////////////////////////////////////////////
+void* operator new (size_t size)
+{
+  ++allocations;
+  void* p = malloc (size ? size : 1);
+  if (! p)
+    throw std::bad_alloc ();
+
+  return p;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void operator delete (void* p) noexcept
+{
+  free (p);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void operator delete (void* p, size_t) noexcept
+{
+  free (p);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+struct result
+{
+  std::string name;
+  long long iterations;
+  double ns;
+  double allocs;
+  double bytes;
+};
+
+static std::vector <result> results;
+static int min_time = 200;
+static const char* filter = "";
+
+////////////////////////////////////////////////////////////////////////////////
+// Runs op repeatedly, in batches long enough to time, until the minimum time
+// has passed.  op returns the output bytes it produced.
+static void bench (const char* name, const std::function <size_t ()>& op)
+{
+  if (! strstr (name, filter))
+    return;
+
+  typedef std::chrono::steady_clock clock;
+
+  // Warm up, and find a batch size that takes at least 10ms.
+  long long batch = 1;
+  while (batch < (1LL << 30))
+  {
+    clock::time_point start = clock::now ();
+    for (long long i = 0; i < batch; ++i)
+      op ();
+
+    if (clock::now () - start >= std::chrono::milliseconds (10))
+      break;
+
+    batch *= 2;
+  }
+
+  long long iterations = 0;
+  size_t bytes = 0;
+  size_t allocated = allocations;
+  clock::time_point start = clock::now ();
+  clock::time_point end;
+  do
+  {
+    for (long long i = 0; i < batch; ++i)
+      bytes += op ();
+
+    iterations += batch;
+    end = clock::now ();
+  }
+  while (end - start < std::chrono::milliseconds (min_time));
+
+  result r;
+  r.name = name;
+  r.iterations = iterations;
+  r.ns = std::chrono::duration <double, std::nano> (end - start).count () / iterations;
+  r.allocs = (double) (allocations - allocated) / iterations;
+  r.bytes = (double) bytes / iterations;
+  results.push_back (r);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draws a list of colored lines, starting with line first.
+static void draw_list (int first)
+{
+  static color c = color_def ("bold yellow on blue");
+  for (int y = 1; y <= HEIGHT; ++y)
+  {
+    char line[64];
+    snprintf (line, sizeof (line), "Item %d of a long and colorful list", first + y - 1);
+    vapi_pos_color_text (1, y, c, line);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Fills the screen with text that differs in every cell from the other parity.
+static void draw_full (int parity)
+{
+  static color colors[] = {color_def ("black on cyan"), color_def ("white on red")};
+  char row[WIDTH + 1];
+  memset (row, parity ? 'x' : 'o', WIDTH);
+  row[WIDTH] = '\0';
+  for (int y = 1; y <= HEIGHT; ++y)
+    vapi_pos_color_text (1, y, colors[parity], row);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Refreshes, and returns the bytes the virtual terminal received.
+static size_t refresh ()
+{
+  size_t bytes;
+  vapi_refresh ();
+  vapi_headless_counts (&bytes, NULL);
+  return bytes;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static void color_benchmarks ()
+{
+  bench ("color_def", [] ()
+  {
+    color_def ("bold red on bright blue");
+    return 0;
+  });
+
+  color c = color_def ("bold red on bright blue");
+  bench ("color_colorize", [c] ()
+  {
+    char buf[64] = "text";
+    return strlen (color_colorize (buf, sizeof (buf), c));
+  });
+
+  int i = 0;
+  bench ("color_downgrade", [&i] ()
+  {
+    color_downgrade (_COLOR_256 | _COLOR_HASFG | (i++ & 0xFF), _COLOR_QUANTIZE_16);
+    return 0;
+  });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static void tapi_benchmarks ()
+{
+  int i = 0;
+  bench ("tapi_get_xy", [&i] ()
+  {
+    char buf[64];
+    ++i;
+    return strlen (tapi_get_xy ("Mv", buf, sizeof (buf), i % WIDTH + 1, i % HEIGHT + 1));
+  });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Drawing straight into the output buffer, which is discarded.
+static void vapi_benchmarks ()
+{
+  vapi_headless (WIDTH, HEIGHT);
+
+  int i = 0;
+  color c = color_def ("bold yellow on blue");
+  bench ("vapi_pos_color_text", [&i, c] ()
+  {
+    ++i;
+    vapi_pos_color_text (i % WIDTH + 1, i % HEIGHT + 1, c, "Hello, world");
+    return vapi_discard ();
+  });
+
+  color blue = color_def ("on blue");
+  bench ("vapi_rectangle", [&i, blue] ()
+  {
+    ++i;
+    vapi_rectangle (i % WIDTH + 1, i % HEIGHT + 1, 20, 5, blue);
+    return vapi_discard ();
+  });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Buffered frames, drawn and refreshed into the virtual terminal.  The diff
+// alone is also measured, without the virtual terminal.
+static void frame_benchmarks ()
+{
+  vapi_headless (WIDTH, HEIGHT);
+  vapi_buffered (1);
+
+  bench ("refresh_unchanged", [] ()
+  {
+    draw_list (1);
+    return refresh ();
+  });
+
+  int first = 0;
+  bench ("refresh_scroll", [&first] ()
+  {
+    draw_list (++first);
+    return refresh ();
+  });
+
+  int parity = 0;
+  bench ("refresh_full", [&parity] ()
+  {
+    draw_full (parity ^= 1);
+    return refresh ();
+  });
+
+  vapi_threads (4);
+  bench ("refresh_full_4_threads", [&parity] ()
+  {
+    draw_full (parity ^= 1);
+    return refresh ();
+  });
+
+  vapi_threads (0);
+  vapi_buffered (0);
+  vapi_headless (0, 0);
+
+  grid frames[2] = {};
+  grid front = {};
+  for (int f = 0; f < 2; ++f)
+  {
+    grid_resize (frames[f], WIDTH, HEIGHT);
+    grid_clear (frames[f]);
+    std::string row (WIDTH, f ? 'x' : 'o');
+    for (int y = 0; y < HEIGHT; ++y)
+      grid_text (frames[f], 0, y, wcolor_def (f ? "white on red" : "black on cyan"),
+                 row.data (), row.length ());
+  }
+
+  grid_resize (front, WIDTH, HEIGHT);
+  std::string out;
+  bench ("screen_diff_full", [&] ()
+  {
+    out.clear ();
+    screen_diff (front, frames[parity ^= 1], out);
+    return out.length ();
+  });
+
+  bench ("screen_diff_unchanged", [&] ()
+  {
+    out.clear ();
+    screen_diff (front, frames[parity], out);
+    return out.length ();
+  });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Line starts and widths of log-like text, with some non-ASCII lines.
+static void line_benchmarks ()
+{
+  std::string text;
+  for (int i = 0; text.length () < 16 * 1024 * 1024; ++i)
+  {
+    char line[128];
+    snprintf (line, sizeof (line), "2017-03-15 10:%02d:%02d worker %d: %s\n", i / 60 % 60,
+              i % 60, i % 16, i % 10 ? "request served" : "r\xc3\xa9ponse \xe6\x97\xa5\xe6\x9c\xac");
+    text += line;
+  }
+
+  line_scanner scanner;
+  std::vector <size_t> starts;
+  std::vector <int> widths;
+  bench ("line_scan", [&] ()
+  {
+    line_scan (scanner, text.data (), text.length (), 1, starts, widths);
+    return text.length ();
+  });
+
+  bench ("line_scan_4_threads", [&] ()
+  {
+    line_scan (scanner, text.data (), text.length (), 4, starts, widths);
+    return text.length ();
+  });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Key decoding, reading sequences from a pipe in place of the terminal.
+static void iapi_benchmarks ()
+{
+  int fds[2];
+  if (pipe (fds) == -1)
+    return;
+
+  int saved = dup (0);
+  dup2 (fds[0], 0);
+
+  // iapi_initialize writes to stdout, which holds the report.
+  std::cout << std::flush;
+  int out = dup (1);
+  int null = open ("/dev/null", O_WRONLY);
+  dup2 (null, 1);
+  iapi_initialize ();
+  std::cout << std::flush;
+  dup2 (out, 1);
+  close (out);
+  close (null);
+
+  int delay = iapi_set_delay (0);
+  // Seven keys: Up, x, F5, y, Down, z and PageUp.  Undecoded sequences would
+  // only leave more keys queued, so getch never blocks.
+  const char keys[] = "\033OAx\033[15~y\033OBz\033[5~";
+  const int count = 7;
+  int pending = 0;
+  bench ("iapi_getch", [&] ()
+  {
+    if (pending == 0)
+    {
+      if (write (fds[1], keys, sizeof (keys) - 1) == -1)
+        return (size_t) 0;
+
+      pending = count;
+    }
+
+    iapi_getch ();
+    --pending;
+    return (size_t) 0;
+  });
+
+  iapi_set_delay (delay);
+  dup2 (saved, 0);
+  close (saved);
+  close (fds[0]);
+  close (fds[1]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static void report ()
+{
+  std::cout << "{\n  \"benchmarks\": [\n";
+  for (size_t i = 0; i < results.size (); ++i)
+  {
+    char line[256];
+    snprintf (line, sizeof (line),
+              "    {\"name\": \"%s\", \"iterations\": %lld, \"ns_per_op\": %.1f, "
+              "\"allocs_per_op\": %.2f, \"bytes_per_op\": %.1f}%s\n",
+              results[i].name.c_str (), results[i].iterations, results[i].ns,
+              results[i].allocs, results[i].bytes,
+              i + 1 < results.size () ? "," : "");
+    std::cout << line;
+  }
+
+  std::cout << "  ]\n}\n";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main (int argc, char** argv)
+{
+  if (argc > 1)
+    min_time = atoi (argv[1]);
+
+  if (argc > 2)
+    filter = argv[2];
+
+  setenv ("TERM", "xterm-256color", 1);
+  if (vapi_initialize ())
+  {
+    std::cerr << "The terminal type xterm-256color is not supported.\n";
+    return 1;
+  }
+
+  color_benchmarks ();
+  tapi_benchmarks ();
+  vapi_benchmarks ();
+  frame_benchmarks ();
+  line_benchmarks ();
+  iapi_benchmarks ();
+
+  vapi_headless (WIDTH, HEIGHT);
+  vapi_deinitialize ();
+  report ();
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
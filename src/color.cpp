@@ -29,10 +29,14 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <map>
 #include <algorithm>
+#include <mutex>
 #include <string.h>
+#include <math.h>
 #include <util.h>
 #include <vitapi.h>
+#include <simd.h>
 #include <check.h>
 
 static std::string error;
@@ -44,11 +48,54 @@ static char color_names[][16] =
 
 #define NUM_COLORS (sizeof (color_names) / sizeof (color_names[0]))
 
+#define SGR_EPILOGUE     "\033[0m"     // Resets all attributes
+#define SGR_EPILOGUE_LEN 4
+
+// SGR prologue cache.  Entries are created on first use of a color, and never
+// evicted, so the returned pointers remain valid.
+struct sgr
+{
+  std::string prologue;
+  bool        terminate;
+};
+
+static std::map <color, sgr> sgr_cache;
+static std::mutex sgr_mutex;            // Guards sgr_cache
+
+// Downgrade tables, indexed by 256-color value, holding the complete fg or bg
+// bits of the nearest 16- or 8-color equivalent.
+struct downgrade_table
+{
+  color fg[256];
+  color bg[256];
+};
+
+static downgrade_table down16;
+static downgrade_table down8;
+static downgrade_table down16_perceptual;
+static downgrade_table down8_perceptual;
+
+// Nearest color cube level (0 - 5) for each 8-bit channel value.
+static unsigned char cube_level[256];
+
+static bool build_downgrade_tables ();
+static bool build_perceptual_tables ();
+static bool downgrade_tables_built = build_downgrade_tables ();
+static bool perceptual_tables_built = build_perceptual_tables ();
+static void set_choice (downgrade_table&, int, int);
+static const downgrade_table* select_table (int);
+static color downgrade (color, const downgrade_table&);
+static const sgr& sgr_lookup (color);
+static void sgr_build (color, sgr&);
 static int color_index (const std::string&);
 static std::string color_fg (color);
 static std::string color_bg (color);
 static void rgb (int, int&, int&, int&);
 static int euclidean_distance (int, int, int, int, int, int);
+static void xterm_rgb (int, int&, int&, int&);
+static bool build_cube_levels ();
+static bool cube_levels_built = build_cube_levels ();
+static void oklab (int, int, int, double&, double&, double&);
 
 ////////////////////////////////////////////////////////////////////////////////
 // Supports the following constructs:
@@ -62,6 +109,10 @@ static int euclidean_distance (int, int, int, int, int, int);
 //   greyN  0 <= N <= 23       fg 38;5;232 + N              bg 48;5;232 + N
 //   colorN 0 <= N <= 255      fg 38;5;N                    bg 48;5;N
 //   rgbRGB 0 <= R,G,B <= 5    fg 38;5;16 + R*36 + G*6 + B  bg 48;5;16 + R*36 + G*6 + B
+//   #rrggbb                   fg 38;5;N                    bg 48;5;N
+//
+// where #rrggbb is quantized to the nearest color N.  See wcolor_def for the
+// unquantized form.
 extern "C" color color_def (const char* def)
 {
   CHECK1 (def, "Null pointer to a color definition passed to color_def.");
@@ -211,6 +262,31 @@ extern "C" color color_def (const char* def)
         fg_value |= _COLOR_256;
       }
     }
+    // #rrggbb, quantized to 256 colors.
+    else if (word[0] == '#')
+    {
+      int r, g, b;
+      if (!hexTriplet (word, r, g, b))
+      {
+        vitapi_set_error ("The color '" + *it + "' is not recognized.");
+        return -1;
+      }
+
+      index = color_rgb_index (r, g, b);
+
+      if (bg)
+      {
+        bg_value |= _COLOR_HASBG;
+        bg_value |= index << 8;
+        bg_value |= _COLOR_256;
+      }
+      else
+      {
+        fg_value |= _COLOR_HASFG;
+        fg_value |= index;
+        fg_value |= _COLOR_256;
+      }
+    }
     else if (word != "")
     {
       vitapi_set_error ("The color '" + *it + "' is not recognized.");
@@ -347,175 +423,109 @@ extern "C" color color_upgrade (color c)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Convert 256- to 16-color, with loss
+// Convert 256- to 16-color, with loss.  All the work is done by the tables.
+// The quantity may include _COLOR_QUANTIZE_PERCEPTUAL.
 extern "C" color color_downgrade (color c, int quantity)
 {
-  if (quantity != _COLOR_QUANTIZE_8 &&
-      quantity != _COLOR_QUANTIZE_16)
+  const downgrade_table* table = select_table (quantity);
+  if (!table)
   {
     vitapi_set_error ("Color downgrade only supports 8 or 16 colors.");
     return -1;
   }
 
-  // Convert to 256 colors, to remove an entire dimension from the matrix.
-  if (!(c & _COLOR_256))
-    c = color_upgrade (c);
-
-  color new_color = 0;
+  return downgrade (c, *table);
+}
 
-  if (quantity == _COLOR_QUANTIZE_16)
+////////////////////////////////////////////////////////////////////////////////
+// Convert an array of colors to 8 or 16 colors.  Input and output may be the
+// same array.  Invalid colors remain invalid.
+extern "C" int color_downgrade_array (
+  const color* in,
+  color* out,
+  size_t count,
+  int quantity)
+{
+  if (!in || !out)
   {
-    static struct
-    {
-      int i;
-      int r;
-      int g;
-      int b;
-    } all[] =
-    {
-      {1,  0, 0, 0},  // black
-      {2,  3, 0, 0},  // red
-      {3,  0, 3, 0},  // green
-      {4,  3, 3, 0},  // yellow
-      {5,  0, 0, 3},  // blue
-      {6,  3, 0, 3},  // magenta
-      {7,  0, 3, 3},  // cyan
-      {8,  3, 3, 3},  // white
-
-      {9,  1, 1, 1},  // light black
-      {10, 5, 1, 1},  // light red
-      {11, 0, 5, 0},  // light green
-      {12, 5, 5, 0},  // light yellow
-      {13, 0, 0, 5},  // light blue
-      {14, 5, 0, 5},  // light magenta
-      {15, 0, 5, 5},  // light cyan
-      {16, 5, 5, 5},  // light white
-    };
-
-    if (c & _COLOR_HASFG)
-    {
-      int r, g, b;
-      rgb (c & _COLOR_FG, r, g, b);
-
-      int distance = 376; // Max value + 1;
-      int choice = 0;
-      for (int i = 0; i < 16; ++i)
-      {
-        int value = euclidean_distance (r, g, b, all[i].r, all[i].g, all[i].b);
-        if (value < distance)
-        {
-          distance = value;
-          choice = all[i].i;
-        }
-      }
+    vitapi_set_error ("Null array pointer passed to color_downgrade_array.");
+    return -1;
+  }
 
-      new_color |= _COLOR_HASFG;
-      if (choice > 8)
-      {
-        new_color |= _COLOR_BOLD;
-        new_color |= choice - 8;
-      }
-      else
-      {
-        new_color |= choice;
-      }
-    }
+  const downgrade_table* table = select_table (quantity);
+  if (!table)
+  {
+    vitapi_set_error ("Color downgrade only supports 8 or 16 colors.");
+    return -1;
+  }
 
-    if (c & _COLOR_HASBG)
-    {
-      int r, g, b;
-      rgb ((c & _COLOR_BG) >> 8, r, g, b);
+  for (size_t i = 0; i < count; ++i)
+    out[i] = in[i] == -1 ? -1 : downgrade (in[i], *table);
 
-      int distance = 376; // Max value + 1;
-      int choice = 0;
-      for (int i = 0; i < 16; ++i)
-      {
-        int value = euclidean_distance (r, g, b, all[i].r, all[i].g, all[i].b);
-        if (value < distance)
-        {
-          distance = value;
-          choice = all[i].i;
-        }
-      }
+  return 0;
+}
 
-      new_color |= _COLOR_HASBG;
-      if (choice > 8)
-      {
-        new_color |= _COLOR_BRIGHT;
-        new_color |= ((choice - 8) << 8);
-      }
-      else
-      {
-        new_color |= (choice << 8);
-      }
-    }
+////////////////////////////////////////////////////////////////////////////////
+// Convert an array of colors from 16- to 256-color.  Input and output may be
+// the same array.  Invalid colors remain invalid.
+extern "C" int color_upgrade_array (const color* in, color* out, size_t count)
+{
+  if (!in || !out)
+  {
+    vitapi_set_error ("Null array pointer passed to color_upgrade_array.");
+    return -1;
   }
 
-  // Determine the rgb value for the color.
-  else if (quantity == _COLOR_QUANTIZE_8)
+  simd_upgrade (in, out, count);
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Nearest 256-color index for a 24-bit color, choosing between the color cube
+// and the gray ramp.
+extern "C" int color_rgb_index (int r, int g, int b)
+{
+  if (r < 0 || r > 255 ||
+      g < 0 || g > 255 ||
+      b < 0 || b > 255)
   {
-    static struct
-    {
-      int i;
-      int r;
-      int g;
-      int b;
-    } all[] =
-    {
-      {1, 0, 0, 0},  // black
-      {2, 3, 0, 0},  // red
-      {3, 0, 3, 0},  // green
-      {4, 3, 3, 0},  // yellow
-      {5, 0, 0, 3},  // blue
-      {6, 3, 0, 3},  // magenta
-      {7, 0, 3, 3},  // cyan
-      {8, 3, 3, 3},  // white
-    };
+    vitapi_set_error ("Invalid component passed to color_rgb_index.");
+    return -1;
+  }
 
-    if (c & _COLOR_HASFG)
-    {
-      int r, g, b;
-      rgb (c & _COLOR_FG, r, g, b);
+  int cube = 16 + cube_level[r] * 36 + cube_level[g] * 6 + cube_level[b];
 
-      int distance = 376; // Max value + 1;
-      int choice = 0;
-      for (int i = 0; i < 8; ++i)
-      {
-        int value = euclidean_distance (r, g, b, all[i].r, all[i].g, all[i].b);
-        if (value < distance)
-        {
-          distance = value;
-          choice = all[i].i;
-        }
-      }
+  int gray = ((r + g + b) / 3 - 3) / 10;
+  gray = min (max (gray, 0), 23);
 
-      new_color |= _COLOR_HASFG;
-      new_color |= choice;
-    }
+  int cr, cg, cb;
+  int gr, gg, gb;
+  xterm_rgb (cube, cr, cg, cb);
+  xterm_rgb (232 + gray, gr, gg, gb);
 
-    if (c & _COLOR_HASBG)
-    {
-      int r, g, b;
-      rgb ((c & _COLOR_BG) >> 8, r, g, b);
+  if (euclidean_distance (r, g, b, gr, gg, gb) <
+      euclidean_distance (r, g, b, cr, cg, cb))
+    return 232 + gray;
 
-      int distance = 376; // Max value + 1;
-      int choice = 0;
-      for (int i = 0; i < 8; ++i)
-      {
-        int value = euclidean_distance (r, g, b, all[i].r, all[i].g, all[i].b);
-        if (value < distance)
-        {
-          distance = value;
-          choice = all[i].i;
-        }
-      }
+  return cube;
+}
 
-      new_color |= _COLOR_HASBG;
-      new_color |= (choice << 8);
-    }
+////////////////////////////////////////////////////////////////////////////////
+// Nearest 256-color indexes for an array of 24-bit 0xRRGGBB values.  Bits above
+// the 24 are ignored.
+extern "C" int color_rgb_index_array (
+  const int* rgb,
+  unsigned char* out,
+  size_t count)
+{
+  if (!rgb || !out)
+  {
+    vitapi_set_error ("Null array pointer passed to color_rgb_index_array.");
+    return -1;
   }
 
-  return new_color;
+  simd_rgb_index (rgb, out, count);
+  return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -586,6 +596,25 @@ extern "C" color color_blend (color one, color two)
   return one;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Blend two arrays of colors, element by element.  The output may be either
+// input array.  Where both colors are invalid, the result is invalid.
+extern "C" int color_blend_array (
+  const color* one,
+  const color* two,
+  color* out,
+  size_t count)
+{
+  if (!one || !two || !out)
+  {
+    vitapi_set_error ("Null array pointer passed to color_blend_array.");
+    return -1;
+  }
+
+  simd_blend (one, two, out, count);
+  return 0;
+}
+
 /////////////////////////////////////////////////////////////////////////////////
 // Sample color codes:
 //   red                  \033[31m
@@ -612,93 +641,213 @@ extern "C" const char* color_colorize (char* buf, size_t size, color c)
     return NULL;
   }
 
-  int count = 0;
-  std::stringstream result;
+  const sgr& s = sgr_lookup (c);
+  size_t prologue_len = s.prologue.length ();
+  size_t epilogue_len = s.terminate ? SGR_EPILOGUE_LEN : 0;
+  size_t len = strlen (buf);
+
+  if (prologue_len + len + epilogue_len + 1 >= size)
+  {
+    vitapi_set_error ("Insufficient buffer size passed to color_colorize.");
+    return buf;
+  }
+
+  // Shift the text right in place, then surround it.
+  memmove (buf + prologue_len, buf, len);
+  memcpy (buf, s.prologue.data (), prologue_len);
+  memcpy (buf + prologue_len + len, SGR_EPILOGUE, epilogue_len);
+  buf[prologue_len + len + epilogue_len] = '\0';
+  return buf;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Write prologue + text + epilogue into a caller-supplied buffer.  The text
+// need not be NUL-terminated, and is never copied into an intermediate.
+// Returns the number of bytes written, not counting the terminating NUL.
+extern "C" int color_colorize_text (
+  char* out,
+  size_t size,
+  color c,
+  const char* text,
+  size_t len)
+{
+  if (!out)
+  {
+    vitapi_set_error ("Null buffer pointer passed to color_colorize_text.");
+    return -1;
+  }
+
+  if (!text)
+  {
+    vitapi_set_error ("Null text pointer passed to color_colorize_text.");
+    return -1;
+  }
+
+  if (c == -1)
+  {
+    vitapi_set_error ("Invalid color passed to color_colorize_text.");
+    return -1;
+  }
+
+  const sgr& s = sgr_lookup (c);
+  size_t prologue_len = s.prologue.length ();
+  size_t epilogue_len = s.terminate ? SGR_EPILOGUE_LEN : 0;
+  size_t total = prologue_len + len + epilogue_len;
+
+  if (total + 1 > size)
+  {
+    vitapi_set_error ("Insufficient buffer size passed to color_colorize_text.");
+    return -1;
+  }
+
+  memcpy (out, s.prologue.data (), prologue_len);
+  memcpy (out + prologue_len, text, len);
+  memcpy (out + prologue_len + len, SGR_EPILOGUE, epilogue_len);
+  out[total] = '\0';
+  return (int) total;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The control sequence that precedes text in color c.  The returned pointer
+// remains valid for the life of the program.
+extern "C" const char* color_prologue (color c, size_t* len)
+{
+  if (c == -1)
+  {
+    vitapi_set_error ("Invalid color passed to color_prologue.");
+    return NULL;
+  }
+
+  const sgr& s = sgr_lookup (c);
+  if (len)
+    *len = s.prologue.length ();
+
+  return s.prologue.c_str ();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The control sequence that follows text in color c.
+extern "C" const char* color_epilogue (color c, size_t* len)
+{
+  if (c == -1)
+  {
+    vitapi_set_error ("Invalid color passed to color_epilogue.");
+    return NULL;
+  }
+
+  bool terminate = sgr_lookup (c).terminate;
+  if (len)
+    *len = terminate ? SGR_EPILOGUE_LEN : 0;
+
+  return terminate ? SGR_EPILOGUE : "";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Finds, or lazily builds, the cached control sequences for a color.  The most
+// recent color is remembered, per thread, because text is usually drawn in
+// runs.  Entries are never removed, so they may be used without the lock.
+static const sgr& sgr_lookup (color c)
+{
+  static thread_local color last_color = -1;
+  static thread_local const sgr* last_sgr = NULL;
+
+  if (last_sgr && c == last_color)
+    return *last_sgr;
+
+  std::lock_guard <std::mutex> lock (sgr_mutex);
+  std::map <color, sgr>::iterator it = sgr_cache.find (c);
+  if (it == sgr_cache.end ())
+  {
+    it = sgr_cache.insert (std::make_pair (c, sgr ())).first;
+    sgr_build (c, it->second);
+  }
+
+  last_color = c;
+  last_sgr = &it->second;
+  return *last_sgr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The longest sequence is 256-color underline inverse fg bg, at 30 bytes.
+static void sgr_build (color c, sgr& s)
+{
+  std::string& result = s.prologue;
+  result.reserve (32);
+  s.terminate = false;
 
   // 256 color
   if (c & _COLOR_256)
   {
-    bool needTerminator = false;
-
     if (c & _COLOR_UNDERLINE)
     {
-      result << "\033[4m";
-      needTerminator = true;
+      result += "\033[4m";
+      s.terminate = true;
     }
 
     if (c & _COLOR_INVERSE)
     {
-      result << "\033[7m";
-      needTerminator = true;
+      result += "\033[7m";
+      s.terminate = true;
     }
 
     if (c & _COLOR_HASFG)
     {
-      result << "\033[38;5;" << (c & _COLOR_FG) << "m";
-      needTerminator = true;
+      result += "\033[38;5;";
+      appendInt (result, c & _COLOR_FG);
+      result += "m";
+      s.terminate = true;
     }
 
     if (c & _COLOR_HASBG)
     {
-      result << "\033[48;5;" << ((c & _COLOR_BG) >> 8) << "m";
-      needTerminator = true;
+      result += "\033[48;5;";
+      appendInt (result, (c & _COLOR_BG) >> 8);
+      result += "m";
+      s.terminate = true;
     }
-
-    result << buf;
-    if (needTerminator)
-      result << "\033[0m";
   }
 
   // 16 color, nontrivial
   else if (c != 0)
   {
-    result << "\033[";
+    int count = 0;
+    result += "\033[";
 
     if (c & _COLOR_BOLD)
     {
-      if (count++) result << ";";
-      result << "1";
+      if (count++) result += ";";
+      result += "1";
     }
 
     if (c & _COLOR_UNDERLINE)
     {
-      if (count++) result << ";";
-      result << "4";
+      if (count++) result += ";";
+      result += "4";
     }
 
     if (c & _COLOR_INVERSE)
     {
-      if (count++) result << ";";
-      result << "7";
+      if (count++) result += ";";
+      result += "7";
     }
 
     if (c & _COLOR_HASFG)
     {
-      if (count++) result << ";";
-      result << (29 + (c & _COLOR_FG));
+      if (count++) result += ";";
+      appendInt (result, 29 + (c & _COLOR_FG));
     }
 
     if (c & _COLOR_HASBG)
     {
-      if (count++) result << ";";
-      result << ((c & _COLOR_BRIGHT ? 99 : 39) + ((c & _COLOR_BG) >> 8));
+      if (count++) result += ";";
+      appendInt (result, (c & _COLOR_BRIGHT ? 99 : 39) + ((c & _COLOR_BG) >> 8));
     }
 
-    result << "m" << buf << "\033[0m";
-  }
-
-  // Trivial
-  else
-    result << buf;
-
-  if (result.str ().size () + 1 >= size)
-  {
-    vitapi_set_error ("Insufficient buffer size passed to color_colorize.");
-    return buf;
+    result += "m";
+    s.terminate = true;
   }
 
-  strncpy (buf, result.str ().c_str (), size);
-  return buf;
+  // Trivial - no sequences at all.
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -751,6 +900,167 @@ static std::string color_bg (color c)
   return "";
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Precomputes the nearest 16- and 8-color for all 256 colors, so that
+// color_downgrade is reduced to table lookups.  Runs once, at load time.
+static bool build_downgrade_tables ()
+{
+  static struct
+  {
+    int i;
+    int r;
+    int g;
+    int b;
+  } all[] =
+  {
+    {1,  0, 0, 0},  // black
+    {2,  3, 0, 0},  // red
+    {3,  0, 3, 0},  // green
+    {4,  3, 3, 0},  // yellow
+    {5,  0, 0, 3},  // blue
+    {6,  3, 0, 3},  // magenta
+    {7,  0, 3, 3},  // cyan
+    {8,  3, 3, 3},  // white
+
+    {9,  1, 1, 1},  // light black
+    {10, 5, 1, 1},  // light red
+    {11, 0, 5, 0},  // light green
+    {12, 5, 5, 0},  // light yellow
+    {13, 0, 0, 5},  // light blue
+    {14, 5, 0, 5},  // light magenta
+    {15, 0, 5, 5},  // light cyan
+    {16, 5, 5, 5},  // light white
+  };
+
+  for (int i = 0; i < 256; ++i)
+  {
+    int r, g, b;
+    rgb (i, r, g, b);
+
+    // The 8-color choices are simply the first half of the 16-color table.
+    int choice8 = 0;
+    int choice16 = 0;
+    int distance = 376; // Max value + 1;
+    for (int j = 0; j < 16; ++j)
+    {
+      int value = euclidean_distance (r, g, b, all[j].r, all[j].g, all[j].b);
+      if (value < distance)
+      {
+        distance = value;
+        choice16 = all[j].i;
+      }
+
+      if (j == 7)
+        choice8 = choice16;
+    }
+
+    set_choice (down8,  i, choice8);
+    set_choice (down16, i, choice16);
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The cube coordinates used above treat all steps as equal, which sends many
+// grays and pastels to the wrong 16-color entry.  These tables instead use the
+// distance in OKLab, a perceptually uniform space, between the sRGB values of
+// the default xterm palette.  Runs once, at load time.
+static bool build_perceptual_tables ()
+{
+  double L[256], A[256], B[256];
+  for (int i = 0; i < 256; ++i)
+  {
+    int r, g, b;
+    xterm_rgb (i, r, g, b);
+    oklab (r, g, b, L[i], A[i], B[i]);
+  }
+
+  for (int i = 0; i < 256; ++i)
+  {
+    // Candidates are colors 0 - 15, which are choices 1 - 16.  A neutral
+    // color only considers the neutral candidates, because a gray shown as a
+    // pale cyan is far more noticeable than a gray that is a little too dark.
+    bool neutral = A[i] * A[i] + B[i] * B[i] < 0.0004;
+
+    int choice8 = 0;
+    int choice16 = 0;
+    double distance = 1e9;
+    for (int j = 0; j < 16; ++j)
+    {
+      if (neutral && j != 0 && j != 7 && j != 8 && j != 15)
+        continue;
+
+      double value = (L[i] - L[j]) * (L[i] - L[j]) +
+                     (A[i] - A[j]) * (A[i] - A[j]) +
+                     (B[i] - B[j]) * (B[i] - B[j]);
+      if (value < distance)
+      {
+        distance = value;
+        choice16 = j + 1;
+      }
+
+      if (j == 7)
+        choice8 = choice16;
+    }
+
+    set_choice (down8_perceptual,  i, choice8);
+    set_choice (down16_perceptual, i, choice16);
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Stores a 1-based choice as complete fg and bg bits.  Choices above 8 use the
+// bold and bright attributes.
+static void set_choice (downgrade_table& table, int i, int choice)
+{
+  if (choice > 8)
+  {
+    table.fg[i] = _COLOR_HASFG | _COLOR_BOLD   | (choice - 8);
+    table.bg[i] = _COLOR_HASBG | _COLOR_BRIGHT | ((choice - 8) << 8);
+  }
+  else
+  {
+    table.fg[i] = _COLOR_HASFG | choice;
+    table.bg[i] = _COLOR_HASBG | (choice << 8);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static const downgrade_table* select_table (int quantity)
+{
+  switch (quantity)
+  {
+  case _COLOR_QUANTIZE_8:                                return &down8;
+  case _COLOR_QUANTIZE_16:                               return &down16;
+  case _COLOR_QUANTIZE_8  | _COLOR_QUANTIZE_PERCEPTUAL:  return &down8_perceptual;
+  case _COLOR_QUANTIZE_16 | _COLOR_QUANTIZE_PERCEPTUAL:  return &down16_perceptual;
+  }
+
+  return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Convert to 256 colors first, to remove an entire dimension from the matrix,
+// then look up the fg and bg separately.
+static color downgrade (color c, const downgrade_table& table)
+{
+  if (!(c & _COLOR_256))
+    c = color_upgrade (c);
+
+  color new_color = 0;
+
+  if (c & _COLOR_HASFG)
+    new_color |= table.fg[c & _COLOR_FG];
+
+  if (c & _COLOR_HASBG)
+    new_color |= table.bg[(c & _COLOR_BG) >> 8];
+
+  return new_color;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 static void rgb (int i, int& r, int& g, int& b)
 {
@@ -803,3 +1113,68 @@ static int euclidean_distance (int r1, int g1, int b1, int r2, int g2, int b2)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
+// The sRGB value of a color in the default xterm palette.
+static void xterm_rgb (int i, int& r, int& g, int& b)
+{
+  static const int basic[16][3] =
+  {
+    {  0,   0,   0}, {205,   0,   0}, {  0, 205,   0}, {205, 205,   0},
+    {  0,   0, 238}, {205,   0, 205}, {  0, 205, 205}, {229, 229, 229},
+    {127, 127, 127}, {255,   0,   0}, {  0, 255,   0}, {255, 255,   0},
+    { 92,  92, 255}, {255,   0, 255}, {  0, 255, 255}, {255, 255, 255},
+  };
+
+  static const int levels[6] = {0, 95, 135, 175, 215, 255};
+
+  // Basic 0 - 15
+  if (i < 16)
+  {
+    r = basic[i][0];
+    g = basic[i][1];
+    b = basic[i][2];
+  }
+
+  // Color cube 16 - 231
+  else if (i < 232)
+  {
+    r = levels[ (i - 16) / 36];
+    g = levels[((i - 16) % 36) / 6];
+    b = levels[ (i - 16) % 6];
+  }
+
+  // Gray ramp 232 - 255
+  else
+  {
+    r = g = b = 8 + (i - 232) * 10;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The cube levels are 0, 95, 135, 175, 215 and 255, so the midpoints between
+// them are the thresholds.
+static bool build_cube_levels ()
+{
+  for (int i = 0; i < 256; ++i)
+    cube_level[i] = i < 48 ? 0 : i < 115 ? 1 : i < 155 ? 2 : i < 195 ? 3 : i < 235 ? 4 : 5;
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// sRGB -> OKLab, see https://bottosson.github.io/posts/oklab/
+static void oklab (int r, int g, int b, double& L, double& A, double& B)
+{
+  double c[3] = {r / 255.0, g / 255.0, b / 255.0};
+  for (int i = 0; i < 3; ++i)
+    c[i] = c[i] <= 0.04045 ? c[i] / 12.92 : pow ((c[i] + 0.055) / 1.055, 2.4);
+
+  double l = cbrt (0.4122214708 * c[0] + 0.5363325363 * c[1] + 0.0514459929 * c[2]);
+  double m = cbrt (0.2119034982 * c[0] + 0.6806995451 * c[1] + 0.1073969566 * c[2]);
+  double s = cbrt (0.0883024619 * c[0] + 0.2817188376 * c[1] + 0.6299787005 * c[2]);
+
+  L = 0.2104542553 * l + 0.7936177850 * m - 0.0040720468 * s;
+  A = 1.9779984951 * l - 2.4285922050 * m + 0.4505937099 * s;
+  B = 0.0259040371 * l + 0.7827717662 * m - 0.8086757660 * s;
+}
+
+////////////////////////////////////////////////////////////////////////////////
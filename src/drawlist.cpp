@@ -0,0 +1,112 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <algorithm>
+#include <drawlist.h>
+#include <util.h>
+
+// Marks a cell of the tape that nothing was drawn into.  No glyph is this long.
+static const cell unset = {0, 0xFF, 1, {0}};
+
+static bool drawn (const cell&);
+
+////////////////////////////////////////////////////////////////////////////////
+// Prepares a grid of unset cells to record drawing into.
+void drawlist_tape (grid& tape, int width, int height)
+{
+  tape.width = width;
+  tape.height = height;
+  tape.cells.assign (width * height, unset);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Records every run of cells drawn into the tape.
+void drawlist_record (drawlist& list, const grid& tape)
+{
+  list.runs.clear ();
+  list.cells.clear ();
+
+  for (int y = 0; y < tape.height; ++y)
+  {
+    const cell* row = tape.row (y);
+    int x = 0;
+    while (x < tape.width)
+    {
+      if (! drawn (row[x]))
+      {
+        ++x;
+        continue;
+      }
+
+      int start = x;
+      while (x < tape.width && drawn (row[x]))
+        ++x;
+
+      run r = {start, y, x - start};
+      list.runs.push_back (r);
+      list.cells.insert (list.cells.end (), row + start, row + x);
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Copies the recorded runs into a grid, offset by [dx,dy] and cropped to the
+// grid.  A double-width character cut by a crop, or by the end of a run, is
+// replaced by a blank.
+void drawlist_replay (const drawlist& list, grid& g, int dx, int dy)
+{
+  const cell* source = list.cells.data ();
+  for (size_t i = 0; i < list.runs.size (); ++i)
+  {
+    const run& r = list.runs[i];
+    int y = r.y + dy;
+    int left = max (r.x + dx, 0);
+    int right = min (r.x + dx + r.count, g.width);
+    if (y >= 0 && y < g.height && left < right)
+    {
+      cell* row = g.row (y);
+      std::copy (source + left - r.x - dx, source + right - r.x - dx, row + left);
+
+      grid_repair (row, g.width, left - 1);
+      grid_repair (row, g.width, left);
+      grid_repair (row, g.width, right - 1);
+      grid_repair (row, g.width, right);
+    }
+
+    source += r.count;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static bool drawn (const cell& c)
+{
+  return c.len != unset.len;
+}
+
+////////////////////////////////////////////////////////////////////////////////
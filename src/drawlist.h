@@ -0,0 +1,57 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDED_DRAWLIST
+#define INCLUDED_DRAWLIST
+
+#include <vector>
+#include <screen.h>
+
+// A horizontal run of cells, zero-based, whose cells are held in the list.
+struct run
+{
+  int x;
+  int y;
+  int count;
+};
+
+// Drawing recorded as runs of finished cells, already clipped and colored.
+struct drawlist
+{
+  std::vector <run> runs;
+  std::vector <cell> cells;
+};
+
+void drawlist_tape (grid&, int, int);
+void drawlist_record (drawlist&, const grid&);
+void drawlist_replay (const drawlist&, grid&, int, int);
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
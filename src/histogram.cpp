@@ -0,0 +1,96 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <histogram.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// The bucket for a value: below HISTOGRAM_EXACT, the value itself, and above,
+// the power of two and the step within it.
+static int bucket (long long value)
+{
+  if (value < HISTOGRAM_EXACT)
+    return value < 0 ? 0 : (int) value;
+
+  int power = 63 - __builtin_clzll (value);
+  int step = (int) (value >> (power - 6)) & (HISTOGRAM_STEPS - 1);
+  int index = HISTOGRAM_EXACT + (power - 7) * HISTOGRAM_STEPS + step;
+  return index < HISTOGRAM_BUCKETS ? index : HISTOGRAM_BUCKETS - 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The largest value counted in a bucket.
+static long long ceiling (int index)
+{
+  if (index < HISTOGRAM_EXACT)
+    return index;
+
+  int power = (index - HISTOGRAM_EXACT) / HISTOGRAM_STEPS + 7;
+  long long step = (index - HISTOGRAM_EXACT) % HISTOGRAM_STEPS;
+  return ((HISTOGRAM_STEPS + step + 1) << (power - 6)) - 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void histogram_clear (histogram& h)
+{
+  memset (&h, 0, sizeof (h));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void histogram_add (histogram& h, long long value)
+{
+  ++h.buckets[bucket (value)];
+  ++h.count;
+  if (value > h.max)
+    h.max = value;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The value below which the given fraction of values fall, to within the
+// bucket size, and never more than the largest value.  Zero if empty.
+long long histogram_percentile (const histogram& h, double fraction)
+{
+  if (h.count == 0)
+    return 0;
+
+  size_t rank = (size_t) (fraction * h.count + 0.5);
+  if (rank < 1)
+    rank = 1;
+
+  size_t seen = 0;
+  for (int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+  {
+    seen += h.buckets[i];
+    if (seen >= rank)
+      return ceiling (i) < h.max ? ceiling (i) : h.max;
+  }
+
+  return h.max;
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,53 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDED_HISTOGRAM
+#define INCLUDED_HISTOGRAM
+
+#include <stddef.h>
+
+#define HISTOGRAM_EXACT   128        // Values counted exactly
+#define HISTOGRAM_STEPS   64         // Buckets per power of two above that
+#define HISTOGRAM_BUCKETS (HISTOGRAM_EXACT + 40 * HISTOGRAM_STEPS)
+
+// Counts of non-negative values, in buckets that are exact for small values
+// and within 1/64 for larger ones, so percentiles cost no memory per value.
+struct histogram
+{
+  size_t buckets[HISTOGRAM_BUCKETS];
+  size_t count;
+  long long max;
+};
+
+void histogram_clear (histogram&);
+void histogram_add (histogram&, long long);
+long long histogram_percentile (const histogram&, double);
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
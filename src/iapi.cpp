@@ -26,12 +26,14 @@
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <chrono>
 #include <iostream>
 #include <map>
 #include <deque>
 #include <string>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <termios.h>
 #include <sys/select.h>
 #include <sys/fcntl.h>
@@ -43,6 +45,8 @@
 
 #include <vitapi.h>
 #include <check.h>
+#include <histogram.h>
+#include <util.h>
 
 static struct termios tty;                    // Original I/O state.
 static std::map <int, std::string> sequences; // Key -> sequence mapping.
@@ -52,6 +56,20 @@ static bool mouse_meta    = false;            // Mouse modifier key.
 static bool mouse_shift   = false;            // Mouse modifier key.
 static int sequence_delay = 1000;             // 10ms delay.  Note: 1ms reduces
                                               // missed sequences in translateMouse.
+static histogram decode_latency;              // Key read to returned, in us.
+static histogram queue_wait;                  // Key read to getch call, in us.
+
+static FILE* input_log = NULL;                // Input being recorded.
+static long long log_start;                   // Time recording started, in us.
+static bool replaying = false;                // Input replayed, not read?
+static bool replay_timed;                     // Replay at the recorded times?
+static std::string replay_data;               // Recorded input being replayed.
+static size_t replay_next;                    // Offset of the next group.
+static long long replay_first;                // Time of the first group, in us.
+static long long replay_start;                // Time replay started, in us.
+
+#define INPUT_MAGIC  "VKEY"                   // Start of recorded input.
+#define INPUT_HEADER 8                        // Magic, version and padding.
 
 #define MAX_TAPI_SIZE 64                      // Max expected key size.
 
@@ -60,6 +78,9 @@ static void translateMouse (std::deque <int>&);
 static bool same (const std::string&, const std::deque <int>&);
 static void blocking (int);
 static void non_blocking (int);
+static long long now ();
+static void replay_input (std::deque <int>&, std::deque <long long>&);
+static void log_input (const std::deque <int>&, size_t);
 
 ////////////////////////////////////////////////////////////////////////////////
 // Initialize for processed input
@@ -269,46 +290,81 @@ extern "C" int iapi_mouse_shift ()
 //    replace those while capturing the mouse position.
 // 7. Return the first item in the queue.
 //
+// Each character is timestamped as it is read, and a translated sequence keeps
+// the time of its first character.  When a key is returned, the time it waited
+// in the queue for this call, and the time this call took to return it once
+// it was read, are added to the latency histograms.
+//
+// Input that is being recorded is logged in the groups each call reads.  When
+// input is replayed, each group is taken in place of reading stdin, so that it
+// is decoded in the same way.  When the replay ends, -1 is returned.
 extern "C" int iapi_getch ()
 {
   // An 'ungetchar' buffer for sequences that were read, but not recognized.
   // This buffer should be depleted before calling fgetc again.
   static std::deque <int> sequence;
+  static std::deque <long long> arrival;
+  long long called = now ();
+  size_t queued = sequence.size ();
   int key;
 
-  // Special case: if the sequence is empty, block on fgetc, waiting for at
-  // least one character.
-  if (sequence.size () == 0)
+  if (replaying)
   {
-/*  TODO Is this the correct way to deal with signals?
-    do
+    replay_input (sequence, arrival);
+    if (sequence.size () == 0)
+      return -1;
+  }
+  else
+  {
+    // Special case: if the sequence is empty, block on fgetc, waiting for at
+    // least one character.
+    if (sequence.size () == 0)
     {
+/*    TODO Is this the correct way to deal with signals?
+      do
+      {
+        key = fgetc (stdin);
+      }
+      while (key == -1 && errno == EAGAIN);
+*/
       key = fgetc (stdin);
+      sequence.push_back (key);
+      arrival.push_back (now ());
+      usleep (sequence_delay);
     }
-    while (key == -1 && errno == EAGAIN);
-*/
-    key = fgetc (stdin);
-    sequence.push_back (key);
+
+    // Now read all pending characters.
     usleep (sequence_delay);
-  }
+    non_blocking (fileno (stdin));
 
-  // Now read all pending characters.
-  usleep (sequence_delay);
-  non_blocking (fileno (stdin));
+    while ((key = fgetc (stdin)) > 0)
+    {
+      sequence.push_back (key);
+      arrival.push_back (now ());
+    }
 
-  while ((key = fgetc (stdin)) > 0)
-    sequence.push_back (key);
+    blocking (fileno (stdin));
 
-  blocking (fileno (stdin));
+    if (input_log)
+      log_input (sequence, queued);
+  }
 
   // Convert sequences into single key values.
+  size_t size = sequence.size ();
   translate (sequence);
   translateMouse (sequence);
+  arrival.erase (arrival.begin () + 1,
+                 arrival.begin () + 1 + (size - sequence.size ()));
 
   // Return the first (perhaps only) key pressed.
   key = sequence[0];
   sequence.pop_front ();
 
+  long long read = arrival[0];
+  arrival.pop_front ();
+  histogram_add (queue_wait, read < called ? called - read : 0);
+  histogram_add (decode_latency, now () - (read < called ? called : read));
+
   return key;
 }
 
@@ -337,6 +393,130 @@ extern "C" int iapi_set_delay (int delay)
   return old_value;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Record the input iapi_getch reads to a file, with the time it was read,
+// until iapi_record_stop.
+extern "C" int iapi_record_start (const char* path)
+{
+  CHECK1 (path, "Null pointer passed to iapi_record_start.");
+
+  if (input_log)
+  {
+    vitapi_set_error ("Input is already being recorded.");
+    return -1;
+  }
+
+  input_log = fopen (path, "wb");
+  if (! input_log)
+  {
+    vitapi_set_error ("The input recording could not be created.");
+    return -1;
+  }
+
+  char header[INPUT_HEADER] = {'V', 'K', 'E', 'Y', 1, 0, 0, 0};
+  fwrite (header, 1, INPUT_HEADER, input_log);
+  log_start = now ();
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+extern "C" int iapi_record_stop ()
+{
+  if (! input_log)
+  {
+    vitapi_set_error ("Input is not being recorded.");
+    return -1;
+  }
+
+  bool ok = ! ferror (input_log);
+  if (fclose (input_log))
+    ok = false;
+
+  input_log = NULL;
+  if (! ok)
+  {
+    vitapi_set_error ("The input recording could not be written.");
+    return -1;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Replay input recorded by iapi_record_start from a buffer, in place of stdin,
+// until iapi_replay_stop.  If timed, input is delivered at the recorded times,
+// relative to the first iapi_getch call, otherwise as fast as it is read.
+extern "C" int iapi_replay_buffer (const char* data, size_t size, int timed)
+{
+  CHECK1 (data, "Null pointer passed to iapi_replay_buffer.");
+
+  if (size < INPUT_HEADER || memcmp (data, INPUT_MAGIC, 4) || data[4] != 1)
+  {
+    vitapi_set_error ("The input recording is not valid.");
+    return -1;
+  }
+
+  replay_data.assign (data, size);
+  replay_next = INPUT_HEADER;
+  replay_timed = timed ? true : false;
+  replay_first = -1;
+  replaying = true;
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Replay input recorded by iapi_record_start from a file.
+extern "C" int iapi_replay_file (const char* path, int timed)
+{
+  CHECK1 (path, "Null pointer passed to iapi_replay_file.");
+
+  FILE* file = fopen (path, "rb");
+  if (! file)
+  {
+    vitapi_set_error ("The input recording could not be read.");
+    return -1;
+  }
+
+  std::string data;
+  char buffer[4096];
+  size_t bytes;
+  while ((bytes = fread (buffer, 1, sizeof (buffer), file)) > 0)
+    data.append (buffer, bytes);
+
+  fclose (file);
+  return iapi_replay_buffer (data.data (), data.length (), timed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Return to reading stdin.
+extern "C" void iapi_replay_stop ()
+{
+  replaying = false;
+  replay_data.clear ();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Get the input latency recorded since the last reset, in microseconds.
+extern "C" void iapi_latency_get (struct iapi_latency* latency)
+{
+  CHECK0 (latency, "Null pointer passed to iapi_latency_get.");
+
+  latency->events     = decode_latency.count;
+  latency->decode_p50 = histogram_percentile (decode_latency, 0.50);
+  latency->decode_p99 = histogram_percentile (decode_latency, 0.99);
+  latency->decode_max = decode_latency.max;
+  latency->wait_p50   = histogram_percentile (queue_wait, 0.50);
+  latency->wait_p99   = histogram_percentile (queue_wait, 0.99);
+  latency->wait_max   = queue_wait.max;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+extern "C" void iapi_latency_reset ()
+{
+  histogram_clear (decode_latency);
+  histogram_clear (queue_wait);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Replace successive keys in the sequence with aggregate codes.
 static void translate (std::deque <int>& sequence)
@@ -515,4 +695,78 @@ static void non_blocking (int fd)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
+// Microseconds on a monotonic clock.
+static long long now ()
+{
+  return std::chrono::duration_cast <std::chrono::microseconds> (
+           std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Queues the next group of replayed input.  With the queue empty, the group
+// is taken at once, though timed replay first waits for its time.  Otherwise
+// it is taken only if timed replay has reached its time.
+static void replay_input (std::deque <int>& sequence, std::deque <long long>& arrival)
+{
+  const unsigned char* data = (const unsigned char*) replay_data.data ();
+  size_t size = replay_data.size ();
+  size_t offset = replay_next;
+  unsigned long long time;
+  unsigned long long length;
+  if (! readVarint (data, size, offset, time)   ||
+      ! readVarint (data, size, offset, length) ||
+      length > size - offset)
+    return;
+
+  if (replay_timed)
+  {
+    if (replay_first == -1)
+    {
+      replay_first = time;
+      replay_start = now ();
+    }
+
+    long long due = replay_start + ((long long) time - replay_first);
+    long long current = now ();
+    if (current < due)
+    {
+      if (sequence.size ())
+        return;
 
+      usleep (due - current);
+    }
+  }
+  else if (sequence.size ())
+    return;
+
+  for (size_t i = 0; i < length; ++i)
+  {
+    sequence.push_back (data[offset + i]);
+    arrival.push_back (now ());
+  }
+
+  replay_next = offset + length;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Logs the characters read since the sequence held queued, as a group: the
+// time, the length and the characters.
+static void log_input (const std::deque <int>& sequence, size_t queued)
+{
+  std::string group;
+  for (size_t i = queued; i < sequence.size (); ++i)
+    if (sequence[i] >= 0)
+      group += (char) sequence[i];
+
+  if (group.empty ())
+    return;
+
+  std::string header;
+  appendVarint (header, now () - log_start);
+  appendVarint (header, group.length ());
+  fwrite (header.data (), 1, header.length (), input_log);
+  fwrite (group.data (), 1, group.length (), input_log);
+  fflush (input_log);
+}
+
+////////////////////////////////////////////////////////////////////////////////
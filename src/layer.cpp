@@ -0,0 +1,151 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <algorithm>
+#include <layer.h>
+#include <util.h>
+
+#define MAX_RECTS 32             // Damage rectangles kept before merging all
+
+static bool below (const layer*, const layer*);
+
+////////////////////////////////////////////////////////////////////////////////
+// Finds the overlap of two rectangles.  Returns false if there is none.
+bool rect_intersect (const rect& a, const rect& b, rect& result)
+{
+  int left   = max (a.x, b.x);
+  int top    = max (a.y, b.y);
+  int right  = min (a.x + a.w, b.x + b.w);
+  int bottom = min (a.y + a.h, b.y + b.h);
+  if (right <= left || bottom <= top)
+    return false;
+
+  result.x = left;
+  result.y = top;
+  result.w = right - left;
+  result.h = bottom - top;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Adds a damaged rectangle to a list.  A rectangle that overlaps or touches
+// the most recent one is merged with it, because drawing tends to proceed
+// row by row.  Too many rectangles are merged into their bounding box.
+void rect_add (std::vector <rect>& list, const rect& r)
+{
+  if (r.w <= 0 || r.h <= 0)
+    return;
+
+  if (! list.empty ())
+  {
+    rect& last = list.back ();
+    if (r.x <= last.x + last.w && last.x <= r.x + r.w &&
+        r.y <= last.y + last.h && last.y <= r.y + r.h)
+    {
+      int right  = max (last.x + last.w, r.x + r.w);
+      int bottom = max (last.y + last.h, r.y + r.h);
+      last.x = min (last.x, r.x);
+      last.y = min (last.y, r.y);
+      last.w = right - last.x;
+      last.h = bottom - last.y;
+      return;
+    }
+  }
+
+  list.push_back (r);
+  if (list.size () > MAX_RECTS)
+  {
+    rect all = list[0];
+    for (size_t i = 1; i < list.size (); ++i)
+    {
+      int right  = max (all.x + all.w, list[i].x + list[i].w);
+      int bottom = max (all.y + all.h, list[i].y + list[i].h);
+      all.x = min (all.x, list[i].x);
+      all.y = min (all.y, list[i].y);
+      all.w = right - all.x;
+      all.h = bottom - all.y;
+    }
+
+    list.clear ();
+    list.push_back (all);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Recomposes the damaged rectangles of the screen from the base grid and the
+// visible layers, lowest first.  Cells outside the damage are left alone.
+void compose (
+  grid& screen,
+  const grid& base,
+  std::vector <layer*>& layers,
+  const std::vector <rect>& damage)
+{
+  std::sort (layers.begin (), layers.end (), below);
+
+  rect whole = {0, 0, screen.width, screen.height};
+  for (size_t d = 0; d < damage.size (); ++d)
+  {
+    rect area;
+    if (! rect_intersect (damage[d], whole, area))
+      continue;
+
+    for (int y = area.y; y < area.y + area.h; ++y)
+      std::copy (base.row (y) + area.x,
+                 base.row (y) + area.x + area.w,
+                 screen.row (y) + area.x);
+
+    for (size_t l = 0; l < layers.size (); ++l)
+    {
+      const layer& top = *layers[l];
+      rect bounds = {top.x, top.y, top.cells.width, top.cells.height};
+      rect overlap;
+      if (! top.visible || ! rect_intersect (area, bounds, overlap))
+        continue;
+
+      for (int y = overlap.y; y < overlap.y + overlap.h; ++y)
+      {
+        const cell* source = top.cells.row (y - top.y) + overlap.x - top.x;
+        std::copy (source, source + overlap.w, screen.row (y) + overlap.x);
+      }
+    }
+
+    // A layer edge may cut a double-width character in half.
+    for (int y = area.y; y < area.y + area.h; ++y)
+      for (int x = area.x - 1; x <= area.x + area.w; ++x)
+        grid_repair (screen.row (y), screen.width, x);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static bool below (const layer* a, const layer* b)
+{
+  return a->z < b->z || (a->z == b->z && a->id < b->id);
+}
+
+////////////////////////////////////////////////////////////////////////////////
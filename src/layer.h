@@ -0,0 +1,62 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDED_LAYER
+#define INCLUDED_LAYER
+
+#include <vector>
+#include <screen.h>
+
+// A rectangle of cells, zero-based.
+struct rect
+{
+  int x;
+  int y;
+  int w;
+  int h;
+};
+
+// An off-screen grid, composited over the base grid at a position, in z-order.
+struct layer
+{
+  int id;
+  int x;
+  int y;
+  int z;
+  bool visible;
+  grid cells;
+};
+
+bool rect_intersect (const rect&, const rect&, rect&);
+void rect_add (std::vector <rect>&, const rect&);
+void compose (grid&, const grid&, std::vector <layer*>&, const std::vector <rect>&);
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,112 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <lines.h>
+#include <simd.h>
+#include <width.h>
+#include <util.h>
+
+#define PIECE_BYTES (256 * 1024) // Smallest piece scanned on a thread of its own
+
+////////////////////////////////////////////////////////////////////////////////
+// Finds the start of each line of text, and the columns it occupies without
+// its line ending, on up to the given number of threads.  Newlines are found
+// with SIMD, a piece per thread, and the pieces' newlines are merged in order.
+// ASCII lines are as wide as they are long, and only other lines are decoded,
+// also in parallel.
+void line_scan (
+  line_scanner& s,
+  const char* text,
+  size_t len,
+  int threads,
+  std::vector <size_t>& starts,
+  std::vector <int>& widths)
+{
+  starts.clear ();
+  widths.clear ();
+  if (len == 0)
+    return;
+
+  int count = max (min (threads, (int) (len / PIECE_BYTES)), 1);
+  s.workers.resize (count - 1);
+  s.pieces.resize (count);
+  for (int p = 0; p < count; ++p)
+  {
+    s.pieces[p].from = len / count * p;
+    s.pieces[p].to = p == count - 1 ? len : len / count * (p + 1);
+  }
+
+  s.workers.run (count, [&s, text] (int p)
+  {
+    line_piece& piece = s.pieces[p];
+    piece.ends.clear ();
+    piece.ascii.clear ();
+    simd_newlines (text + piece.from, piece.to - piece.from, piece.ends, piece.ascii);
+  });
+
+  // A line that spans pieces is ASCII if each part of it is.
+  s.ascii.clear ();
+  starts.push_back (0);
+  bool clean = true;
+  for (int p = 0; p < count; ++p)
+  {
+    const line_piece& piece = s.pieces[p];
+    for (size_t i = 0; i < piece.ends.size (); ++i)
+    {
+      s.ascii.push_back (clean && piece.ascii[i]);
+      clean = true;
+
+      size_t next = piece.from + piece.ends[i] + 1;
+      if (next < len)
+        starts.push_back (next);
+    }
+
+    clean = clean && piece.ascii.back ();
+  }
+
+  if (s.ascii.size () < starts.size ())
+    s.ascii.push_back (clean);
+
+  widths.resize (starts.size ());
+  size_t lines = starts.size ();
+  s.workers.run (count, [&s, &starts, &widths, text, len, lines, count] (int p)
+  {
+    for (size_t l = lines / count * p; l < (p == count - 1 ? lines : lines / count * (p + 1)); ++l)
+    {
+      size_t end = l + 1 < lines ? starts[l + 1] : len;
+      if (end > starts[l] && text[end - 1] == '\n')
+        --end;
+      if (end > starts[l] && text[end - 1] == '\r')
+        --end;
+
+      widths[l] = s.ascii[l] ? end - starts[l] : utf8_width (text + starts[l], end - starts[l]);
+    }
+  });
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,58 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDED_LINES
+#define INCLUDED_LINES
+
+#include <stddef.h>
+#include <vector>
+#include <pool.h>
+
+// The newlines found in one piece of text, and whether each line is ASCII.
+struct line_piece
+{
+  size_t from;                           // Offset of the piece in the text
+  size_t to;
+  std::vector <size_t> ends;             // Offsets of newlines in the piece
+  std::vector <unsigned char> ascii;     // Per line, one more than ends
+};
+
+// Finds the lines of large texts, splitting each into pieces that are scanned
+// in parallel.  The threads and scratch space are kept between scans.
+struct line_scanner
+{
+  pool workers;
+  std::vector <line_piece> pieces;
+  std::vector <unsigned char> ascii;     // Merged, per line
+};
+
+void line_scan (line_scanner&, const char*, size_t, int, std::vector <size_t>&, std::vector <int>&);
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,143 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <pool.h>
+
+////////////////////////////////////////////////////////////////////////////////
+pool::pool ()
+: job (NULL)
+, tasks (0)
+, next (0)
+, busy (0)
+, generation (0)
+, stopping (false)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+pool::~pool ()
+{
+  stop ();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Changes the number of worker threads.  The calling thread also takes tasks,
+// so 0 workers means tasks are run serially.
+void pool::resize (int count)
+{
+  if (count == size ())
+    return;
+
+  stop ();
+  for (int i = 0; i < count; ++i)
+    threads.push_back (std::thread (&pool::work, this, generation));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int pool::size () const
+{
+  return threads.size ();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Runs task (0) to task (count - 1) on the workers and the calling thread, and
+// returns when all are finished.  The order in which tasks run is undefined.
+void pool::run (int count, const std::function <void (int)>& task)
+{
+  if (threads.empty () || count < 2)
+  {
+    for (int i = 0; i < count; ++i)
+      task (i);
+
+    return;
+  }
+
+  {
+    std::lock_guard <std::mutex> lock (mutex);
+    job = &task;
+    tasks = count;
+    next = 0;
+    busy = threads.size ();
+    ++generation;
+  }
+
+  start.notify_all ();
+  take ();
+
+  std::unique_lock <std::mutex> lock (mutex);
+  done.wait (lock, [this] { return busy == 0; });
+  job = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void pool::stop ()
+{
+  {
+    std::lock_guard <std::mutex> lock (mutex);
+    stopping = true;
+  }
+
+  start.notify_all ();
+  for (size_t i = 0; i < threads.size (); ++i)
+    threads[i].join ();
+
+  threads.clear ();
+  stopping = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Each worker waits for a job newer than the last one it saw, takes tasks until
+// none remain, and reports that it is finished.
+void pool::work (unsigned seen)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+  while (true)
+  {
+    start.wait (lock, [&] { return stopping || generation != seen; });
+    if (stopping)
+      return;
+
+    seen = generation;
+    lock.unlock ();
+    take ();
+    lock.lock ();
+
+    if (--busy == 0)
+      done.notify_one ();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void pool::take ()
+{
+  for (int i = next++; i < tasks; i = next++)
+    (*job) (i);
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,601 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <record.h>
+#include <util.h>
+
+#define MAGIC       "VREC"       // Start of a recording
+#define INDEX_MAGIC "VIDX"       // End of a recording with an index
+#define HEADER_SIZE 8            // Magic, version and padding
+#define TRAILER_SIZE 12          // Index offset and magic
+#define VERSION     1
+
+#define KEYFRAME    'K'
+#define DIFF        'D'
+#define INDEX       'I'
+
+#define CELL        0x80         // Not a plain ASCII cell
+#define WIDE        0x10         // Double-width glyph
+#define SAME_COLOR  0x00         // Color of the cell before
+#define OLD_COLOR   0x20         // Color by number, then the number
+#define NEW_COLOR   0x40         // New color, then the color
+#define COLOR_MODE  0x60
+#define MAX_CELLS   (1 << 24)    // Largest grid a recording may hold
+
+static void put_cell (std::string&, const cell&, wcolor&, std::map <wcolor, size_t>&);
+static bool get_cell (const unsigned char*, size_t, size_t&, cell&, wcolor&, std::vector <wcolor>&);
+static bool equal (const cell&, const cell&);
+static void write_record (recorder&, char, long long, const std::string&);
+static bool read_record (const player&, size_t, size_t, char&, long long&, size_t&, size_t&);
+static bool apply (player&, char, size_t, size_t);
+static bool read_index (player&);
+static void scan (player&);
+
+////////////////////////////////////////////////////////////////////////////////
+// Starts a recording with a keyframe every interval frames.
+bool recorder_open (recorder& r, const char* path, int interval)
+{
+  r.file = fopen (path, "wb");
+  if (! r.file)
+    return false;
+
+  unsigned char header[HEADER_SIZE] = {'V', 'R', 'E', 'C', VERSION, 0, 0, 0};
+  fwrite (header, 1, HEADER_SIZE, r.file);
+
+  r.offset = HEADER_SIZE;
+  r.interval = max (interval, 1);
+  r.since_key = 0;
+  r.time = -1;
+  r.last.width = 0;
+  r.last.height = 0;
+  r.last.cells.clear ();
+  r.palette.clear ();
+  r.index.clear ();
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Records a frame, at a time in microseconds.  A frame that has not changed is
+// not recorded.
+void recorder_frame (recorder& r, const grid& g, long long time)
+{
+  std::string payload;
+  wcolor color = 0;
+
+  if (r.index.empty ()          ||
+      r.since_key >= r.interval ||
+      r.last.width != g.width   ||
+      r.last.height != g.height)
+  {
+    r.palette.clear ();
+    appendVarint (payload, g.width);
+    appendVarint (payload, g.height);
+
+    size_t count = g.cells.size ();
+    for (size_t i = 0; i < count; )
+    {
+      size_t repeat = 1;
+      while (i + repeat < count && equal (g.cells[i + repeat], g.cells[i]))
+        ++repeat;
+
+      appendVarint (payload, repeat);
+      put_cell (payload, g.cells[i], color, r.palette);
+      i += repeat;
+    }
+
+    keyframe k = {time, r.offset};
+    r.index.push_back (k);
+    write_record (r, KEYFRAME, time, payload);
+    r.since_key = 0;
+  }
+  else
+  {
+    size_t count = g.cells.size ();
+    size_t end = 0;
+    for (size_t i = 0; i < count; )
+    {
+      if (equal (g.cells[i], r.last.cells[i]))
+      {
+        ++i;
+        continue;
+      }
+
+      size_t start = i;
+      while (i < count && ! equal (g.cells[i], r.last.cells[i]))
+        ++i;
+
+      appendVarint (payload, start - end);
+      appendVarint (payload, i - start);
+      for (size_t j = start; j < i; ++j)
+        put_cell (payload, g.cells[j], color, r.palette);
+
+      end = i;
+    }
+
+    if (payload.empty ())
+      return;
+
+    write_record (r, DIFF, time, payload);
+  }
+
+  ++r.since_key;
+  r.time = time;
+  r.last.width = g.width;
+  r.last.height = g.height;
+  r.last.cells = g.cells;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Ends a recording with the index of keyframes, which a player uses to seek.
+// Returns false if anything could not be written.
+bool recorder_close (recorder& r)
+{
+  std::string payload;
+  appendVarint (payload, r.index.size ());
+  for (size_t i = 0; i < r.index.size (); ++i)
+  {
+    appendVarint (payload, r.index[i].time);
+    appendVarint (payload, r.index[i].offset);
+  }
+
+  size_t offset = r.offset;
+  write_record (r, INDEX, r.time, payload);
+
+  unsigned char trailer[TRAILER_SIZE];
+  for (int i = 0; i < 8; ++i)
+    trailer[i] = (offset >> (8 * i)) & 0xFF;
+
+  memcpy (trailer + 8, INDEX_MAGIC, 4);
+  fwrite (trailer, 1, TRAILER_SIZE, r.file);
+
+  bool ok = ! ferror (r.file);
+  if (fclose (r.file))
+    ok = false;
+
+  r.file = NULL;
+  r.last.cells.clear ();
+  r.palette.clear ();
+  r.index.clear ();
+  return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Maps a recording into memory, positioned before the first frame.  A recording
+// that was not closed has no index, and is scanned for keyframes instead, up to
+// the last complete frame.
+bool player_open (player& p, const char* path)
+{
+  p.data = NULL;
+  p.size = 0;
+
+  int fd = open (path, O_RDONLY);
+  if (fd == -1)
+    return false;
+
+  struct stat s;
+  if (fstat (fd, &s) == -1 || s.st_size < HEADER_SIZE)
+  {
+    close (fd);
+    return false;
+  }
+
+  void* data = mmap (NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED)
+    return false;
+
+  p.data = (const unsigned char*) data;
+  p.size = s.st_size;
+  if (memcmp (p.data, MAGIC, 4) || p.data[4] != VERSION)
+  {
+    player_close (p);
+    return false;
+  }
+
+  p.next = HEADER_SIZE;
+  p.time = -1;
+  p.screen.width = 0;
+  p.screen.height = 0;
+  p.screen.cells.clear ();
+  if (! read_index (p))
+    scan (p);
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void player_close (player& p)
+{
+  if (p.data)
+    munmap ((void*) p.data, p.size);
+
+  p.data = NULL;
+  p.size = 0;
+  p.screen.cells.clear ();
+  p.palette.clear ();
+  p.index.clear ();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Moves to the next frame.  Returns false at the end of the recording.
+bool player_next (player& p)
+{
+  char type;
+  long long time;
+  size_t start;
+  size_t stop;
+  if (p.next >= p.end ||
+      ! read_record (p, p.next, p.end, type, time, start, stop))
+    return false;
+
+  // A damaged frame ends the recording.
+  if (! apply (p, type, start, stop))
+  {
+    p.end = p.next;
+    return false;
+  }
+
+  p.time = time;
+  p.next = stop;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The time of the next frame, or -1 at the end of the recording.
+long long player_peek (const player& p)
+{
+  char type;
+  long long time;
+  size_t start;
+  size_t stop;
+  if (p.next >= p.end ||
+      ! read_record (p, p.next, p.end, type, time, start, stop))
+    return -1;
+
+  return time;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Moves to the last frame at or before a time, by decoding the keyframe before
+// it and the frames from there.  Before the first frame, the screen is empty.
+void player_seek (player& p, long long time)
+{
+  std::vector <keyframe>::const_iterator k = std::upper_bound (
+    p.index.begin (), p.index.end (), time,
+    [] (long long t, const keyframe& f) { return t < f.time; });
+
+  p.time = -1;
+  p.screen.width = 0;
+  p.screen.height = 0;
+  p.screen.cells.clear ();
+  if (k == p.index.begin ())
+  {
+    p.next = HEADER_SIZE;
+    return;
+  }
+
+  p.next = (k - 1)->offset;
+  if (! player_next (p))
+    return;
+
+  long long next;
+  while ((next = player_peek (p)) != -1 && next <= time)
+    player_next (p);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// A single-width ASCII glyph in the color of the cell before is just that byte.
+// Any other cell is a byte of CELL, the color mode, WIDE and the glyph length,
+// then the color or its number if needed, then the glyph.  A glyph of no length
+// is the right half of a double-width character.
+static void put_cell (
+  std::string& out,
+  const cell& c,
+  wcolor& previous,
+  std::map <wcolor, size_t>& palette)
+{
+  if (c.color == previous &&
+      c.len == 1          &&
+      c.width == 1        &&
+      ! (c.glyph[0] & 0x80))
+  {
+    out += c.glyph[0];
+    return;
+  }
+
+  std::map <wcolor, size_t>::iterator number = palette.find (c.color);
+  int mode = c.color == previous     ? SAME_COLOR
+           : number != palette.end () ? OLD_COLOR
+           :                            NEW_COLOR;
+
+  out += (char) (CELL | mode | (c.width == 2 ? WIDE : 0) | c.len);
+  if (mode == OLD_COLOR)
+    appendVarint (out, number->second);
+  else if (mode == NEW_COLOR)
+  {
+    appendVarint (out, (unsigned long long) c.color);
+    size_t next = palette.size ();
+    palette[c.color] = next;
+  }
+
+  out.append (c.glyph, c.len);
+  previous = c.color;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static bool get_cell (
+  const unsigned char* data,
+  size_t end,
+  size_t& offset,
+  cell& c,
+  wcolor& previous,
+  std::vector <wcolor>& palette)
+{
+  if (offset >= end)
+    return false;
+
+  unsigned char byte = data[offset++];
+  if (! (byte & CELL))
+  {
+    c.color = previous;
+    c.len = 1;
+    c.width = 1;
+    c.glyph[0] = byte;
+    return true;
+  }
+
+  c.len = byte & 0x0F;
+  c.width = c.len == 0 ? 0 : byte & WIDE ? 2 : 1;
+  if (c.len > sizeof (c.glyph))
+    return false;
+
+  int mode = byte & COLOR_MODE;
+  unsigned long long value;
+  if (mode != SAME_COLOR && ! readVarint (data, end, offset, value))
+    return false;
+
+  if (mode == OLD_COLOR)
+  {
+    if (value >= palette.size ())
+      return false;
+
+    previous = palette[value];
+  }
+  else if (mode == NEW_COLOR)
+  {
+    previous = (wcolor) value;
+    palette.push_back (previous);
+  }
+  else if (mode != SAME_COLOR)
+    return false;
+
+  c.color = previous;
+  if (offset + c.len > end)
+    return false;
+
+  memcpy (c.glyph, data + offset, c.len);
+  offset += c.len;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static bool equal (const cell& a, const cell& b)
+{
+  return a.color == b.color &&
+         a.width == b.width &&
+         a.len   == b.len   &&
+         ! memcmp (a.glyph, b.glyph, a.len);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static void write_record (
+  recorder& r,
+  char type,
+  long long time,
+  const std::string& payload)
+{
+  std::string header (1, type);
+  appendVarint (header, time);
+  appendVarint (header, payload.length ());
+
+  fwrite (header.data (), 1, header.length (), r.file);
+  fwrite (payload.data (), 1, payload.length (), r.file);
+  r.offset += header.length () + payload.length ();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Reads the record header at offset, which must end by end.  The payload is
+// from start to stop.
+static bool read_record (
+  const player& p,
+  size_t offset,
+  size_t end,
+  char& type,
+  long long& time,
+  size_t& start,
+  size_t& stop)
+{
+  if (offset >= end)
+    return false;
+
+  type = p.data[offset++];
+  unsigned long long t;
+  unsigned long long length;
+  if (! readVarint (p.data, end, offset, t) ||
+      ! readVarint (p.data, end, offset, length) ||
+      length > end - offset)
+    return false;
+
+  time = (long long) t;
+  start = offset;
+  stop = offset + length;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Decodes a frame into the screen.
+static bool apply (player& p, char type, size_t start, size_t stop)
+{
+  size_t offset = start;
+  wcolor color = 0;
+  cell c;
+
+  if (type == KEYFRAME)
+  {
+    unsigned long long width;
+    unsigned long long height;
+    if (! readVarint (p.data, stop, offset, width) ||
+        ! readVarint (p.data, stop, offset, height) ||
+        width * height > MAX_CELLS)
+      return false;
+
+    p.palette.clear ();
+    p.screen.width = width;
+    p.screen.height = height;
+    p.screen.cells.resize (width * height);
+
+    size_t count = width * height;
+    for (size_t i = 0; i < count; )
+    {
+      unsigned long long repeat;
+      if (! readVarint (p.data, stop, offset, repeat) ||
+          repeat == 0 || repeat > count - i           ||
+          ! get_cell (p.data, stop, offset, c, color, p.palette))
+        return false;
+
+      std::fill (p.screen.cells.begin () + i, p.screen.cells.begin () + i + repeat, c);
+      i += repeat;
+    }
+
+    return true;
+  }
+
+  if (type == DIFF && p.screen.width > 0)
+  {
+    size_t count = p.screen.cells.size ();
+    size_t i = 0;
+    while (offset < stop)
+    {
+      unsigned long long gap;
+      unsigned long long run;
+      if (! readVarint (p.data, stop, offset, gap) ||
+          ! readVarint (p.data, stop, offset, run) ||
+          gap > count - i || run > count - i - gap)
+        return false;
+
+      i += gap;
+      for (unsigned long long j = 0; j < run; ++j)
+        if (! get_cell (p.data, stop, offset, p.screen.cells[i++], color, p.palette))
+          return false;
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Reads the index that ends a closed recording.
+static bool read_index (player& p)
+{
+  if (p.size < HEADER_SIZE + TRAILER_SIZE ||
+      memcmp (p.data + p.size - 4, INDEX_MAGIC, 4))
+    return false;
+
+  size_t offset = 0;
+  for (int i = 0; i < 8; ++i)
+    offset |= (size_t) p.data[p.size - TRAILER_SIZE + i] << (8 * i);
+
+  char type;
+  long long time;
+  size_t start;
+  size_t stop;
+  if (offset < HEADER_SIZE ||
+      ! read_record (p, offset, p.size - TRAILER_SIZE, type, time, start, stop) ||
+      type != INDEX)
+    return false;
+
+  unsigned long long count;
+  if (! readVarint (p.data, stop, start, count))
+    return false;
+
+  p.index.clear ();
+  for (unsigned long long i = 0; i < count; ++i)
+  {
+    unsigned long long t;
+    unsigned long long o;
+    if (! readVarint (p.data, stop, start, t) ||
+        ! readVarint (p.data, stop, start, o) ||
+        o < HEADER_SIZE || o >= offset)
+      return false;
+
+    keyframe k = {(long long) t, (size_t) o};
+    p.index.push_back (k);
+  }
+
+  p.end = offset;
+  p.length = time;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Finds the keyframes by reading every record header.
+static void scan (player& p)
+{
+  p.index.clear ();
+  p.length = -1;
+
+  char type;
+  long long time;
+  size_t start;
+  size_t stop;
+  size_t offset = HEADER_SIZE;
+  while (read_record (p, offset, p.size, type, time, start, stop) &&
+         (type == KEYFRAME || type == DIFF))
+  {
+    if (type == KEYFRAME)
+    {
+      keyframe k = {time, offset};
+      p.index.push_back (k);
+    }
+
+    p.length = time;
+    offset = stop;
+  }
+
+  p.end = offset;
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,89 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDED_RECORD
+#define INCLUDED_RECORD
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <screen.h>
+
+// A recording is a header, then a record per frame, then an index of the
+// keyframes.  Each record is a type byte, a time in microseconds and a payload
+// length, as varints, and the payload.  A keyframe holds the whole grid as
+// runs of repeated cells; any other frame holds runs of the cells that changed
+// since the last frame.  Colors are numbered as they first appear after a
+// keyframe, and then given by number.
+struct keyframe
+{
+  long long time;
+  size_t offset;
+};
+
+// Writes frames to a recording.
+struct recorder
+{
+  FILE* file;
+  size_t offset;                         // Bytes written
+  int interval;                          // Frames between keyframes
+  int since_key;                         // Frames since the last keyframe
+  long long time;                        // Time of the last frame
+  grid last;                             // The last frame recorded
+  std::map <wcolor, size_t> palette;     // Colors since the last keyframe
+  std::vector <keyframe> index;
+};
+
+// Reads frames from a memory-mapped recording.
+struct player
+{
+  const unsigned char* data;
+  size_t size;
+  size_t next;                           // Offset of the next record
+  size_t end;                            // Offset of the end of the frames
+  long long time;                        // Time of the current frame, or -1
+  long long length;                      // Time of the last frame, or -1
+  grid screen;                           // The current frame
+  std::vector <wcolor> palette;          // Colors since the last keyframe
+  std::vector <keyframe> index;
+};
+
+bool recorder_open (recorder&, const char*, int);
+void recorder_frame (recorder&, const grid&, long long);
+bool recorder_close (recorder&);
+
+bool player_open (player&, const char*);
+void player_close (player&);
+bool player_next (player&);
+long long player_peek (const player&);
+void player_seek (player&, long long);
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,657 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <algorithm>
+#include <utility>
+#include <string.h>
+#include <stdlib.h>
+#include <screen.h>
+#include <width.h>
+#include <pool.h>
+#include <util.h>
+
+#define MAX_TAPI_SIZE   64       // Max expected key size.
+#define MAX_GAP          8       // Longest run of unchanged cells rewritten
+#define MAX_SCROLLS      3       // Scrolls detected per frame
+#define SCROLL_COST     16       // Bytes to scroll a region
+#define RUN_COST        12       // Bytes to move and set colors for a run
+#define BAND_ROWS        8       // Rows diffed as one parallel task
+#define PARALLEL_CELLS 16384     // Smallest frame diffed in parallel by default
+#define MAX_THREADS      4       // Most threads used by default
+
+static const cell blank = {0, 1, 1, {' '}};
+
+static pool workers;             // Threads that diff bands of rows
+static int threads = 0;          // Threads diffing a frame, or 0 for automatic
+
+// Scratch space kept between frames, so that a diff does not allocate once the
+// frame size has been seen.
+static std::vector <unsigned long long> back_hash;
+static bool back_hashed = false; // Does back_hash hold this frame's hashes?
+static std::vector <int> changed;
+static std::vector <std::pair <unsigned long long, int> > front_order;
+static std::vector <std::pair <unsigned long long, int> > back_order;
+static std::vector <int> covered; // Shift of the run found through each row
+static std::vector <std::string> segments;
+static std::vector <diff_counts> tallies;
+
+static void put (cell*, int, int, wcolor, const char*, size_t, int);
+static bool same (const cell&, const cell&);
+static bool same_row (const cell*, const cell*, int);
+static unsigned long long hash_row (const cell*, int);
+static bool detect_scroll (grid&, const grid&, std::string&);
+static void sort_rows (const std::vector <unsigned long long>&, std::vector <std::pair <unsigned long long, int> >&);
+static int unique_row (const std::vector <std::pair <unsigned long long, int> >&, unsigned long long);
+static bool shifted (const grid&, const grid&, int, int);
+static void diff_row (const cell*, const cell*, int, int, std::string&, diff_counts&);
+
+////////////////////////////////////////////////////////////////////////////////
+// Resizes the grid, keeping the overlapping cells.  New cells are blank.
+void grid_resize (grid& g, int width, int height)
+{
+  std::vector <cell> cells (width * height, blank);
+  for (int y = 0; y < min (height, g.height); ++y)
+    for (int x = 0; x < min (width, g.width); ++x)
+      cells[y * width + x] = g.cells[y * g.width + x];
+
+  // A double-width character cut by the new right edge is removed.
+  if (width < g.width)
+    for (int y = 0; y < min (height, g.height); ++y)
+      if (cells[y * width + width - 1].width == 2)
+        cells[y * width + width - 1] = blank;
+
+  g.width = width;
+  g.height = height;
+  g.cells.swap (cells);
+  g.hashes.clear ();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void grid_clear (grid& g)
+{
+  g.cells.assign (g.width * g.height, blank);
+  g.hashes.clear ();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Writes text at [x,y], cropped to the grid.  The text may start off the left
+// edge.  A double-width character cut by an edge is replaced by a blank.
+int grid_text (grid& g, int x, int y, wcolor c, const char* text, size_t len)
+{
+  if (y < 0 || y >= g.height || x >= g.width)
+    return x;
+
+  size_t start;
+  size_t end;
+  int lpad;
+  int rpad;
+  int col = max (x, 0);
+  utf8_clip (text, len, x < 0 ? -x : 0, g.width - col, start, end, lpad, rpad);
+
+  g.hashes.clear ();
+  cell* row = g.row (y);
+  int first = col;
+  for (int i = 0; i < lpad; ++i)
+    put (row, g.width, col++, c, " ", 1, 1);
+
+  size_t i = start;
+  while (i < end)
+  {
+    size_t from = i;
+    int w = utf8_char_width (utf8_decode (text, end, i));
+    if (w)
+    {
+      put (row, g.width, col, c, text + from, i - from, w);
+      col += w;
+    }
+
+    // A combining character joins the preceding cell, if there is room.
+    else if (col > first)
+    {
+      cell& owner = row[col - 1].width == 0 ? row[col - 2] : row[col - 1];
+      if (owner.len + (i - from) <= sizeof (owner.glyph))
+      {
+        memcpy (owner.glyph + owner.len, text + from, i - from);
+        owner.len += i - from;
+      }
+    }
+  }
+
+  for (int i = 0; i < rpad; ++i)
+    put (row, g.width, col++, c, " ", 1, 1);
+
+  return col;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Fills a rectangle, already cropped to the grid, with a single-column glyph.
+void grid_fill (
+  grid& g,
+  int x,
+  int y,
+  int w,
+  int h,
+  wcolor c,
+  const char* glyph,
+  size_t len)
+{
+  g.hashes.clear ();
+  for (int row = y; row < y + h; ++row)
+    for (int col = x; col < x + w; ++col)
+      put (g.row (row), g.width, col, c, glyph, len, 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scrolls rows top to bottom up by n, or down if n is negative.  The exposed
+// rows are blank, as they are on the terminal.  Row hashes move with the rows.
+void grid_scroll (grid& g, int top, int bottom, int n)
+{
+  int rows = bottom - top + 1;
+  int count = min (abs (n), rows);
+  if (count == 0)
+    return;
+
+  cell* region = g.row (top);
+  size_t keep = (rows - count) * g.width;
+  if (n > 0)
+  {
+    memmove (region, region + count * g.width, keep * sizeof (cell));
+    std::fill (region + keep, region + rows * g.width, blank);
+  }
+  else
+  {
+    memmove (region + count * g.width, region, keep * sizeof (cell));
+    std::fill (region, region + count * g.width, blank);
+  }
+
+  if ((int) g.hashes.size () == g.height)
+  {
+    unsigned long long* hashes = &g.hashes[top];
+    unsigned long long empty = hash_row (n > 0 ? g.row (bottom) : g.row (top), g.width);
+    if (n > 0)
+    {
+      memmove (hashes, hashes + count, (rows - count) * sizeof (*hashes));
+      std::fill (hashes + rows - count, hashes + rows, empty);
+    }
+    else
+    {
+      memmove (hashes + count, hashes, (rows - count) * sizeof (*hashes));
+      std::fill (hashes, hashes + count, empty);
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Blanks the cell at column x of a row if it is half of a double-width
+// character whose other half was overwritten.  Columns off the row are ignored.
+void grid_repair (cell* row, int width, int x)
+{
+  if (x < 0 || x >= width)
+    return;
+
+  if ((row[x].width == 2 && (x + 1 >= width || row[x + 1].width != 0)) ||
+      (row[x].width == 0 && (x == 0 || row[x - 1].width != 2)))
+  {
+    wcolor other = row[x].color;
+    row[x] = blank;
+    row[x].color = other;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The control sequences that scroll rows top to bottom (one-based) up by n,
+// or down if n is negative, and then reset the scroll region to the given
+// screen height.  Returns false if the terminal cannot scroll a region.
+bool scroll_sequence (std::string& out, int top, int bottom, int n, int height)
+{
+  char seq[MAX_TAPI_SIZE] = "";
+  tapi_get_xy ("cs", seq, MAX_TAPI_SIZE, top, bottom);
+  if (! seq[0])
+    return false;
+
+  int count = min (abs (n), bottom - top + 1);
+  if (count == 0)
+    return true;
+
+  // Terminals ignore a region of one row, which is simply erased instead.
+  if (top == bottom)
+  {
+    char ce[MAX_TAPI_SIZE] = "";
+    char mv[MAX_TAPI_SIZE] = "";
+    if (! tapi_get ("ce", ce, MAX_TAPI_SIZE)[0])
+      return false;
+
+    out += tapi_get_xy ("Mv", mv, MAX_TAPI_SIZE, 1, top);
+    out += ce;
+    return true;
+  }
+
+  out += seq;
+
+  // Prefer scrolling by a count, otherwise index or reverse index repeatedly
+  // at the edge of the region.
+  seq[0] = '\0';
+  tapi_get_n (n > 0 ? "SF" : "SR", seq, MAX_TAPI_SIZE, count);
+  if (seq[0])
+    out += seq;
+  else
+  {
+    char mv[MAX_TAPI_SIZE] = "";
+    out += tapi_get_xy ("Mv", mv, MAX_TAPI_SIZE, 1, n > 0 ? bottom : top);
+    tapi_get (n > 0 ? "sf" : "sr", seq, MAX_TAPI_SIZE);
+    for (int i = 0; i < count; ++i)
+      out += seq;
+  }
+
+  out += tapi_get_xy ("cs", seq, MAX_TAPI_SIZE, 1, height);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Appends the output that changes the terminal from front to back, and updates
+// front to match.  Vertical shifts are detected first, and scrolled.  Each row
+// is then drawn independently: it starts with a move, in the default colors,
+// and ends in the default colors.
+//
+// Because rows are independent, a large frame is split into bands of rows that
+// are diffed in parallel, each into its own segment.  The segments are joined
+// in order, so the output is the same as when diffed serially.
+//
+// If counts is given, what was written is added to it.
+void screen_diff (
+  grid& front,
+  const grid& back,
+  std::string& out,
+  diff_counts* counts)
+{
+  diff_counts total = {0, 0, 0};
+
+  back_hashed = false;
+  for (int i = 0; i < MAX_SCROLLS; ++i)
+    if (! detect_scroll (front, back, out))
+      break;
+
+  int count = threads;
+  if (count == 0)
+    count = back.width * back.height >= PARALLEL_CELLS
+          ? min ((int) std::thread::hardware_concurrency (), MAX_THREADS)
+          : 1;
+
+  int bands = (back.height + BAND_ROWS - 1) / BAND_ROWS;
+  if (count > 1 && bands > 1)
+  {
+    workers.resize (count - 1);
+
+    // Segments are cleared, not replaced, so that they keep their capacity.
+    // The task captures only two references, which std::function stores
+    // without allocating.
+    segments.resize (bands);
+    for (int band = 0; band < bands; ++band)
+      segments[band].clear ();
+
+    tallies.assign (bands, total);
+    workers.run (bands, [&front, &back] (int band)
+    {
+      int last = min ((band + 1) * BAND_ROWS, back.height);
+      for (int y = band * BAND_ROWS; y < last; ++y)
+        diff_row (front.row (y), back.row (y), back.width, y, segments[band],
+                  tallies[band]);
+    });
+
+    for (int band = 0; band < bands; ++band)
+    {
+      out += segments[band];
+      total.moves += tallies[band].moves;
+      total.sgr   += tallies[band].sgr;
+      total.cells += tallies[band].cells;
+    }
+  }
+  else
+  {
+    for (int y = 0; y < back.height; ++y)
+      diff_row (front.row (y), back.row (y), back.width, y, out, total);
+  }
+
+  // Front now matches back, so back's row hashes are front's.  If they were
+  // not computed, nothing changed, and front's still hold.
+  front.cells = back.cells;
+  if (back_hashed)
+    front.hashes = back_hash;
+
+  if (counts)
+  {
+    counts->moves += total.moves;
+    counts->sgr   += total.sgr;
+    counts->cells += total.cells;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Sets the number of threads that diff a frame, including the calling thread,
+// or 0 to choose automatically.  Returns the previous setting.
+int screen_threads (int count)
+{
+  int previous = threads;
+  threads = count;
+  return previous;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Puts a glyph at row[x].  Overwriting half of a double-width character
+// leaves a blank in the other half.
+static void put (
+  cell* row,
+  int width,
+  int x,
+  wcolor c,
+  const char* glyph,
+  size_t len,
+  int w)
+{
+  if (row[x].width == 0 && x > 0)
+  {
+    wcolor other = row[x - 1].color;
+    row[x - 1] = blank;
+    row[x - 1].color = other;
+  }
+
+  if (row[x + w - 1].width == 2 && x + w < width)
+  {
+    wcolor other = row[x + w].color;
+    row[x + w] = blank;
+    row[x + w].color = other;
+  }
+
+  cell& target = row[x];
+  target.color = c;
+  target.len = min (len, sizeof (target.glyph));
+  target.width = w;
+  memcpy (target.glyph, glyph, target.len);
+
+  if (w == 2)
+  {
+    row[x + 1].color = c;
+    row[x + 1].len = 0;
+    row[x + 1].width = 0;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static bool same (const cell& a, const cell& b)
+{
+  return a.color == b.color &&
+         a.width == b.width &&
+         a.len   == b.len   &&
+         ! memcmp (a.glyph, b.glyph, a.len);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static bool same_row (const cell* a, const cell* b, int width)
+{
+  for (int x = 0; x < width; ++x)
+    if (! same (a[x], b[x]))
+      return false;
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// FNV-1a, over the significant bytes of each cell.
+static unsigned long long hash_row (const cell* row, int width)
+{
+  unsigned long long h = 14695981039346656037ULL;
+  for (int x = 0; x < width; ++x)
+  {
+    const unsigned char* color = (const unsigned char*) &row[x].color;
+    for (size_t i = 0; i < sizeof (wcolor); ++i)
+      h = (h ^ color[i]) * 1099511628211ULL;
+
+    h = (h ^ row[x].width) * 1099511628211ULL;
+    for (int i = 0; i < row[x].len; ++i)
+      h = (h ^ (unsigned char) row[x].glyph[i]) * 1099511628211ULL;
+  }
+
+  return h;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Looks for a run of rows in back that match rows in front, shifted
+// vertically.  If the bytes needed to redraw those rows in place outweigh the
+// cost of scrolling, the terminal and front are scrolled.
+//
+// Only changed rows can make a scroll worthwhile, so an unchanged frame costs
+// one comparison of the rows.  Otherwise a changed row that is unique in back,
+// and whose hash is unique in front, anchors a match, which is extended over
+// the neighbouring rows that match with the same shift.  Front's row hashes
+// are kept from the last frame, and unchanged rows need not be hashed again.
+static bool detect_scroll (grid& front, const grid& back, std::string& out)
+{
+  int height = back.height;
+  int width = back.width;
+
+  // Estimate the bytes needed to redraw each row in place.
+  changed.resize (height);
+  bool any = false;
+  for (int y = 0; y < height; ++y)
+  {
+    changed[y] = 0;
+    if (same_row (front.row (y), back.row (y), width))
+      continue;
+
+    bool run = false;
+    for (int x = 0; x < width; ++x)
+    {
+      bool differs = ! same (front.row (y)[x], back.row (y)[x]);
+      if (differs)
+        changed[y] += run ? 1 : 1 + RUN_COST;
+
+      run = differs;
+    }
+
+    any = true;
+  }
+
+  if (! any)
+    return false;
+
+  if ((int) front.hashes.size () != height)
+  {
+    front.hashes.resize (height);
+    for (int y = 0; y < height; ++y)
+      front.hashes[y] = hash_row (front.row (y), width);
+  }
+
+  back_hash.resize (height);
+  for (int y = 0; y < height; ++y)
+    back_hash[y] = changed[y] ? hash_row (back.row (y), width) : front.hashes[y];
+
+  back_hashed = true;
+
+  sort_rows (front.hashes, front_order);
+  sort_rows (back_hash, back_order);
+
+  // Back row i matches front row i + shift, for rows first to last.
+  int best_gain = SCROLL_COST;
+  int best_first = 0;
+  int best_last = 0;
+  int best_shift = 0;
+  covered.assign (height, 0);
+  for (int i = 0; i < height; ++i)
+  {
+    if (! changed[i] || unique_row (back_order, back_hash[i]) != i)
+      continue;
+
+    int j = unique_row (front_order, back_hash[i]);
+    int shift = j - i;
+    if (j == -1 || shift == 0 || covered[i] == shift || ! shifted (front, back, i, shift))
+      continue;
+
+    int first = i;
+    int last = i;
+    while (first > 0 && first + shift > 0 && shifted (front, back, first - 1, shift))
+      --first;
+    while (last + 1 < height && last + 1 + shift < height && shifted (front, back, last + 1, shift))
+      ++last;
+
+    int gain = 0;
+    for (int k = first; k <= last; ++k)
+    {
+      gain += changed[k];
+      covered[k] = shift;
+    }
+
+    if (gain > best_gain)
+    {
+      best_gain = gain;
+      best_first = first;
+      best_last = last;
+      best_shift = shift;
+    }
+  }
+
+  if (best_shift == 0)
+    return false;
+
+  // The region spans the rows moved, and the rows they move over.
+  int top    = best_shift > 0 ? best_first : best_first + best_shift;
+  int bottom = best_shift > 0 ? best_last + best_shift : best_last;
+  if (! scroll_sequence (out, top + 1, bottom + 1, best_shift, height))
+    return false;
+
+  grid_scroll (front, top, bottom, best_shift);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Pairs each row hash with its row, and sorts them by hash.
+static void sort_rows (
+  const std::vector <unsigned long long>& hashes,
+  std::vector <std::pair <unsigned long long, int> >& order)
+{
+  order.resize (hashes.size ());
+  for (size_t y = 0; y < hashes.size (); ++y)
+    order[y] = std::make_pair (hashes[y], (int) y);
+
+  std::sort (order.begin (), order.end ());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The only row with a hash, or -1 if there are none or several.
+static int unique_row (
+  const std::vector <std::pair <unsigned long long, int> >& order,
+  unsigned long long hash)
+{
+  std::vector <std::pair <unsigned long long, int> >::const_iterator r =
+    std::lower_bound (order.begin (), order.end (), std::make_pair (hash, -1));
+  if (r == order.end () || r->first != hash)
+    return -1;
+
+  if (r + 1 != order.end () && (r + 1)->first == hash)
+    return -1;
+
+  return r->second;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Does back row y match front row y + shift?
+static bool shifted (const grid& front, const grid& back, int y, int shift)
+{
+  return back_hash[y] == front.hashes[y + shift] &&
+         same_row (back.row (y), front.row (y + shift), back.width);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draws the changed cells of a row.  Short runs of unchanged cells in the
+// current color are rewritten, when that is shorter than moving over them.
+static void diff_row (
+  const cell* front,
+  const cell* back,
+  int width,
+  int y,
+  std::string& out,
+  diff_counts& counts)
+{
+  int cursor = -1;
+  wcolor current = 0;
+
+  for (int x = 0; x < width; ++x)
+  {
+    // The right half of a double-width character is drawn with the left.
+    if (back[x].width == 0)
+      continue;
+
+    if (same (front[x], back[x]) &&
+        (back[x].width == 1 || x + 1 >= width || same (front[x + 1], back[x + 1])))
+      continue;
+
+    if (cursor != x)
+    {
+      char mv[MAX_TAPI_SIZE] = "";
+      tapi_get_xy ("Mv", mv, MAX_TAPI_SIZE, x + 1, y + 1);
+
+      bool rewrite = cursor != -1 && x - cursor <= MAX_GAP;
+      size_t bytes = 0;
+      for (int i = cursor; rewrite && i < x; ++i)
+      {
+        rewrite = back[i].color == current;
+        bytes += back[i].len;
+      }
+
+      if (rewrite && bytes < strlen (mv))
+      {
+        for (int i = cursor; i < x; ++i)
+          out.append (back[i].glyph, back[i].len);
+
+        counts.cells += x - cursor;
+      }
+      else
+      {
+        out += mv;
+        ++counts.moves;
+      }
+    }
+
+    if (back[x].color != current)
+    {
+      out += wcolor_epilogue (current, NULL);
+      out += wcolor_prologue (back[x].color, NULL);
+      current = back[x].color;
+      ++counts.sgr;
+    }
+
+    out.append (back[x].glyph, back[x].len);
+    cursor = x + back[x].width;
+    counts.cells += back[x].width;
+  }
+
+  if (cursor != -1)
+    out += wcolor_epilogue (current, NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
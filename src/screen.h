@@ -0,0 +1,83 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDED_SCREEN
+#define INCLUDED_SCREEN
+
+#include <string>
+#include <vector>
+#include <vitapi.h>
+
+// One character cell.  A double-width character occupies two cells, the
+// second of which has no glyph and zero width.  Combining characters are kept
+// with the character they follow, as far as the glyph has room.
+struct cell
+{
+  wcolor color;
+  unsigned char len;                     // Bytes in glyph
+  unsigned char width;                   // Columns: 0, 1 or 2
+  char glyph[14];
+};
+
+// A grid of cells.  Coordinates are zero-based.  The hashes of the rows are
+// kept by screen_diff for the grid it diffs against, and are dropped by the
+// grid functions that change cells.
+struct grid
+{
+  int width;
+  int height;
+  std::vector <cell> cells;
+  std::vector <unsigned long long> hashes; // Row hashes, or empty if unknown
+
+  cell* row (int y)             { return &cells[y * width]; }
+  const cell* row (int y) const { return &cells[y * width]; }
+};
+
+void grid_resize (grid&, int, int);
+void grid_clear (grid&);
+int grid_text (grid&, int, int, wcolor, const char*, size_t);
+void grid_fill (grid&, int, int, int, int, wcolor, const char*, size_t);
+void grid_scroll (grid&, int, int, int);
+void grid_repair (cell*, int, int);
+
+// What a diff wrote, for statistics.
+struct diff_counts
+{
+  size_t moves;                          // Cursor moves
+  size_t sgr;                            // Color changes
+  size_t cells;                          // Cells written
+};
+
+bool scroll_sequence (std::string&, int, int, int, int);
+void screen_diff (grid&, const grid&, std::string&, diff_counts* = NULL);
+int screen_threads (int);
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
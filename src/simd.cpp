@@ -0,0 +1,607 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <vitapi.h>
+#include <simd.h>
+
+// SSE2 is part of x86-64, and AVX2 is selected at runtime.  Other platforms
+// use the scalar loops.
+#if defined (__GNUC__) && defined (__SSE2__) && !defined (VITAPI_NO_SIMD)
+#define HAVE_SSE2
+#include <emmintrin.h>
+#if defined (__x86_64__) || defined (__i386__)
+#define HAVE_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+#define RGB_COMPONENT(v,shift) (((v) >> (shift)) & 0xFF)
+
+////////////////////////////////////////////////////////////////////////////////
+// Records the newlines in a block of text, given the bits of its newline bytes
+// and of its non-ASCII bytes.  A line is ASCII if no high bit is set between
+// its start and its newline, which clean tracks across blocks.
+static inline void mark_lines (
+  size_t offset,
+  unsigned int lines,
+  unsigned int high,
+  std::vector <size_t>& ends,
+  std::vector <unsigned char>& ascii,
+  bool& clean)
+{
+  while (lines)
+  {
+    int bit = __builtin_ctz (lines);
+    unsigned int before = (1u << bit) - 1;
+    if (high & before)
+      clean = false;
+
+    ends.push_back (offset + bit);
+    ascii.push_back (clean);
+    clean = true;
+    high &= ~before;
+    lines &= lines - 1;
+  }
+
+  if (high)
+    clean = false;
+}
+
+#ifdef HAVE_SSE2
+////////////////////////////////////////////////////////////////////////////////
+// Each 32-bit lane holds one value throughout.  The cube level of a component
+// is the number of thresholds it exceeds, which matches the cube_level table.
+static inline __m128i select_sse2 (__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128 (_mm_and_si128 (mask, a), _mm_andnot_si128 (mask, b));
+}
+
+static inline __m128i level_sse2 (__m128i x)
+{
+  __m128i l = _mm_setzero_si128 ();
+  l = _mm_sub_epi32 (l, _mm_cmpgt_epi32 (x, _mm_set1_epi32 (47)));
+  l = _mm_sub_epi32 (l, _mm_cmpgt_epi32 (x, _mm_set1_epi32 (114)));
+  l = _mm_sub_epi32 (l, _mm_cmpgt_epi32 (x, _mm_set1_epi32 (154)));
+  l = _mm_sub_epi32 (l, _mm_cmpgt_epi32 (x, _mm_set1_epi32 (194)));
+  l = _mm_sub_epi32 (l, _mm_cmpgt_epi32 (x, _mm_set1_epi32 (234)));
+  return l;
+}
+
+// Level 0 is 0, otherwise 55 + 40 * level.
+static inline __m128i level_value_sse2 (__m128i l)
+{
+  __m128i v = _mm_add_epi32 (_mm_add_epi32 (_mm_slli_epi32 (l, 5), _mm_slli_epi32 (l, 3)),
+                             _mm_set1_epi32 (55));
+  return _mm_andnot_si128 (_mm_cmpeq_epi32 (l, _mm_setzero_si128 ()), v);
+}
+
+// The differences fit in 16 bits, so madd squares them into 32 bits.
+static inline __m128i square_sse2 (__m128i a, __m128i b)
+{
+  __m128i d = _mm_and_si128 (_mm_sub_epi32 (a, b), _mm_set1_epi32 (0xFFFF));
+  return _mm_madd_epi16 (d, d);
+}
+
+static void rgb_index_sse2 (const int* rgb, unsigned char* out, size_t count)
+{
+  const __m128i ff = _mm_set1_epi32 (0xFF);
+
+  for (size_t i = 0; i < count; i += 4)
+  {
+    __m128i v = _mm_loadu_si128 ((const __m128i*) (rgb + i));
+    __m128i r = _mm_and_si128 (_mm_srli_epi32 (v, 16), ff);
+    __m128i g = _mm_and_si128 (_mm_srli_epi32 (v, 8), ff);
+    __m128i b = _mm_and_si128 (v, ff);
+
+    // Color cube: 16 + 36r + 6g + b.
+    __m128i lr = level_sse2 (r);
+    __m128i lg = level_sse2 (g);
+    __m128i lb = level_sse2 (b);
+    __m128i cube = _mm_add_epi32 (
+                     _mm_add_epi32 (_mm_slli_epi32 (lr, 5), _mm_slli_epi32 (lr, 2)),
+                     _mm_add_epi32 (_mm_add_epi32 (_mm_slli_epi32 (lg, 2), _mm_slli_epi32 (lg, 1)),
+                                    _mm_add_epi32 (lb, _mm_set1_epi32 (16))));
+
+    // Gray ramp: ((r + g + b) / 3 - 3) / 10, clamped to 0 - 23.  The divisions
+    // are reciprocal multiplications, exact over these ranges.
+    __m128i sum  = _mm_add_epi32 (_mm_add_epi32 (r, g), b);
+    __m128i avg  = _mm_mulhi_epu16 (sum, _mm_set1_epi32 (21846));
+    __m128i t    = _mm_max_epi16 (_mm_sub_epi32 (avg, _mm_set1_epi32 (3)), _mm_setzero_si128 ());
+    __m128i gray = _mm_min_epi16 (_mm_mulhi_epu16 (t, _mm_set1_epi32 (6554)), _mm_set1_epi32 (23));
+    __m128i gv   = _mm_add_epi32 (_mm_add_epi32 (_mm_slli_epi32 (gray, 3), _mm_slli_epi32 (gray, 1)),
+                                  _mm_set1_epi32 (8));
+
+    __m128i dc = _mm_add_epi32 (_mm_add_epi32 (square_sse2 (r, level_value_sse2 (lr)),
+                                               square_sse2 (g, level_value_sse2 (lg))),
+                                square_sse2 (b, level_value_sse2 (lb)));
+    __m128i dg = _mm_add_epi32 (_mm_add_epi32 (square_sse2 (r, gv), square_sse2 (g, gv)),
+                                square_sse2 (b, gv));
+
+    __m128i index = select_sse2 (_mm_cmplt_epi32 (dg, dc),
+                                 _mm_add_epi32 (gray, _mm_set1_epi32 (232)),
+                                 cube);
+
+    __m128i packed = _mm_packus_epi16 (_mm_packs_epi32 (index, index), index);
+    int bytes = _mm_cvtsi128_si32 (packed);
+    memcpy (out + i, &bytes, 4);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Mirrors color_upgrade, including its treatment of out-of-range fields.
+static inline __m128i upgrade_sse2 (__m128i c)
+{
+  const __m128i c256   = _mm_set1_epi32 (_COLOR_256);
+  const __m128i hasfg  = _mm_set1_epi32 (_COLOR_HASFG);
+  const __m128i hasbg  = _mm_set1_epi32 (_COLOR_HASBG);
+  const __m128i bold   = _mm_set1_epi32 (_COLOR_BOLD);
+  const __m128i bright = _mm_set1_epi32 (_COLOR_BRIGHT);
+  const __m128i seven  = _mm_set1_epi32 (7);
+  const __m128i one    = _mm_set1_epi32 (1);
+
+  __m128i is256 = _mm_cmpeq_epi32 (_mm_and_si128 (c, c256), c256);
+
+  __m128i fg     = _mm_and_si128 (c, _mm_set1_epi32 (_COLOR_FG));
+  __m128i bolded = _mm_cmpeq_epi32 (_mm_and_si128 (c, bold), bold);
+  __m128i new_fg = select_sse2 (bolded, _mm_add_epi32 (fg, seven), _mm_sub_epi32 (fg, one));
+  __m128i c1     = select_sse2 (_mm_cmpeq_epi32 (_mm_and_si128 (c, hasfg), hasfg),
+                                _mm_or_si128 (_mm_andnot_si128 (_mm_set1_epi32 (_COLOR_FG | _COLOR_BOLD), c), new_fg),
+                                c);
+
+  __m128i bg       = _mm_srli_epi32 (_mm_and_si128 (c1, _mm_set1_epi32 (_COLOR_BG)), 8);
+  __m128i brighted = _mm_cmpeq_epi32 (_mm_and_si128 (c1, bright), bright);
+  __m128i new_bg   = select_sse2 (brighted, _mm_add_epi32 (bg, seven), _mm_sub_epi32 (bg, one));
+  __m128i c2       = select_sse2 (_mm_cmpeq_epi32 (_mm_and_si128 (c1, hasbg), hasbg),
+                                  _mm_or_si128 (_mm_andnot_si128 (_mm_set1_epi32 (_COLOR_BG | _COLOR_BRIGHT), c1),
+                                                _mm_slli_epi32 (new_bg, 8)),
+                                  c1);
+
+  return select_sse2 (is256, c, _mm_or_si128 (c2, c256));
+}
+
+static void upgrade_array_sse2 (const color* in, color* out, size_t count)
+{
+  for (size_t i = 0; i < count; i += 4)
+    _mm_storeu_si128 ((__m128i*) (out + i),
+                      upgrade_sse2 (_mm_loadu_si128 ((const __m128i*) (in + i))));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Copies the fg and bg from 'two' into 'one', where 'two' has them.
+static inline __m128i apply_sse2 (__m128i one, __m128i two)
+{
+  const __m128i hasfg = _mm_set1_epi32 (_COLOR_HASFG);
+  const __m128i hasbg = _mm_set1_epi32 (_COLOR_HASBG);
+  const __m128i fg    = _mm_set1_epi32 (_COLOR_FG);
+  const __m128i bg    = _mm_set1_epi32 (_COLOR_BG);
+
+  one = select_sse2 (_mm_cmpeq_epi32 (_mm_and_si128 (two, hasfg), hasfg),
+                     _mm_or_si128 (_mm_or_si128 (_mm_andnot_si128 (fg, one), hasfg), _mm_and_si128 (two, fg)),
+                     one);
+  one = select_sse2 (_mm_cmpeq_epi32 (_mm_and_si128 (two, hasbg), hasbg),
+                     _mm_or_si128 (_mm_or_si128 (_mm_andnot_si128 (bg, one), hasbg), _mm_and_si128 (two, bg)),
+                     one);
+  return one;
+}
+
+// Mirrors color_blend.  Both the 16-color and 256-color results are computed,
+// and each lane selects the appropriate one.
+static void blend_array_sse2 (const color* a, const color* b, color* out, size_t count)
+{
+  const __m128i invalid = _mm_set1_epi32 (-1);
+  const __m128i c256    = _mm_set1_epi32 (_COLOR_256);
+
+  for (size_t i = 0; i < count; i += 4)
+  {
+    __m128i one = _mm_loadu_si128 ((const __m128i*) (a + i));
+    __m128i two = _mm_loadu_si128 ((const __m128i*) (b + i));
+
+    __m128i r = _mm_or_si128 (one, _mm_and_si128 (two, _mm_set1_epi32 (_COLOR_UNDERLINE | _COLOR_INVERSE)));
+    __m128i both16 = _mm_cmpeq_epi32 (_mm_and_si128 (_mm_or_si128 (r, two), c256), _mm_setzero_si128 ());
+
+    __m128i result16  = apply_sse2 (_mm_or_si128 (r, _mm_and_si128 (two, _mm_set1_epi32 (_COLOR_BOLD | _COLOR_BRIGHT))), two);
+    __m128i result256 = apply_sse2 (upgrade_sse2 (r), upgrade_sse2 (two));
+
+    __m128i result = select_sse2 (both16, result16, result256);
+    result = select_sse2 (_mm_cmpeq_epi32 (two, invalid), one, result);
+    result = select_sse2 (_mm_cmpeq_epi32 (one, invalid), two, result);
+    _mm_storeu_si128 ((__m128i*) (out + i), result);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The high bit of each byte is gathered into a mask, and the first set bit is
+// the first non-ASCII byte.
+static size_t ascii_prefix_sse2 (const char* text, size_t len)
+{
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16)
+  {
+    int mask = _mm_movemask_epi8 (_mm_loadu_si128 ((const __m128i*) (text + i)));
+    if (mask)
+      return i + __builtin_ctz (mask);
+  }
+
+  return i;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static size_t newlines_sse2 (
+  const char* text,
+  size_t len,
+  std::vector <size_t>& ends,
+  std::vector <unsigned char>& ascii,
+  bool& clean)
+{
+  const __m128i newline = _mm_set1_epi8 ('\n');
+
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16)
+  {
+    __m128i v = _mm_loadu_si128 ((const __m128i*) (text + i));
+    mark_lines (i, _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, newline)),
+                _mm_movemask_epi8 (v), ends, ascii, clean);
+  }
+
+  return i;
+}
+#endif
+
+#ifdef HAVE_AVX2
+////////////////////////////////////////////////////////////////////////////////
+// The AVX2 versions are the SSE2 versions, eight lanes at a time.
+#define AVX2 __attribute__ ((target ("avx2")))
+
+AVX2 static inline __m256i select_avx2 (__m256i mask, __m256i a, __m256i b)
+{
+  return _mm256_blendv_epi8 (b, a, mask);
+}
+
+AVX2 static inline __m256i level_avx2 (__m256i x)
+{
+  __m256i l = _mm256_setzero_si256 ();
+  l = _mm256_sub_epi32 (l, _mm256_cmpgt_epi32 (x, _mm256_set1_epi32 (47)));
+  l = _mm256_sub_epi32 (l, _mm256_cmpgt_epi32 (x, _mm256_set1_epi32 (114)));
+  l = _mm256_sub_epi32 (l, _mm256_cmpgt_epi32 (x, _mm256_set1_epi32 (154)));
+  l = _mm256_sub_epi32 (l, _mm256_cmpgt_epi32 (x, _mm256_set1_epi32 (194)));
+  l = _mm256_sub_epi32 (l, _mm256_cmpgt_epi32 (x, _mm256_set1_epi32 (234)));
+  return l;
+}
+
+AVX2 static inline __m256i level_value_avx2 (__m256i l)
+{
+  __m256i v = _mm256_add_epi32 (_mm256_mullo_epi32 (l, _mm256_set1_epi32 (40)), _mm256_set1_epi32 (55));
+  return _mm256_andnot_si256 (_mm256_cmpeq_epi32 (l, _mm256_setzero_si256 ()), v);
+}
+
+AVX2 static inline __m256i square_avx2 (__m256i a, __m256i b)
+{
+  __m256i d = _mm256_sub_epi32 (a, b);
+  return _mm256_mullo_epi32 (d, d);
+}
+
+AVX2 static void rgb_index_avx2 (const int* rgb, unsigned char* out, size_t count)
+{
+  const __m256i ff = _mm256_set1_epi32 (0xFF);
+
+  for (size_t i = 0; i < count; i += 8)
+  {
+    __m256i v = _mm256_loadu_si256 ((const __m256i*) (rgb + i));
+    __m256i r = _mm256_and_si256 (_mm256_srli_epi32 (v, 16), ff);
+    __m256i g = _mm256_and_si256 (_mm256_srli_epi32 (v, 8), ff);
+    __m256i b = _mm256_and_si256 (v, ff);
+
+    __m256i lr = level_avx2 (r);
+    __m256i lg = level_avx2 (g);
+    __m256i lb = level_avx2 (b);
+    __m256i cube = _mm256_add_epi32 (
+                     _mm256_add_epi32 (_mm256_mullo_epi32 (lr, _mm256_set1_epi32 (36)),
+                                       _mm256_mullo_epi32 (lg, _mm256_set1_epi32 (6))),
+                     _mm256_add_epi32 (lb, _mm256_set1_epi32 (16)));
+
+    __m256i sum  = _mm256_add_epi32 (_mm256_add_epi32 (r, g), b);
+    __m256i avg  = _mm256_mulhi_epu16 (sum, _mm256_set1_epi32 (21846));
+    __m256i t    = _mm256_max_epi32 (_mm256_sub_epi32 (avg, _mm256_set1_epi32 (3)), _mm256_setzero_si256 ());
+    __m256i gray = _mm256_min_epi32 (_mm256_mulhi_epu16 (t, _mm256_set1_epi32 (6554)), _mm256_set1_epi32 (23));
+    __m256i gv   = _mm256_add_epi32 (_mm256_mullo_epi32 (gray, _mm256_set1_epi32 (10)), _mm256_set1_epi32 (8));
+
+    __m256i dc = _mm256_add_epi32 (_mm256_add_epi32 (square_avx2 (r, level_value_avx2 (lr)),
+                                                     square_avx2 (g, level_value_avx2 (lg))),
+                                   square_avx2 (b, level_value_avx2 (lb)));
+    __m256i dg = _mm256_add_epi32 (_mm256_add_epi32 (square_avx2 (r, gv), square_avx2 (g, gv)),
+                                   square_avx2 (b, gv));
+
+    __m256i index = select_avx2 (_mm256_cmpgt_epi32 (dc, dg),
+                                 _mm256_add_epi32 (gray, _mm256_set1_epi32 (232)),
+                                 cube);
+
+    // Packing works within 128-bit halves, so each half yields four bytes.
+    __m256i packed = _mm256_packus_epi16 (_mm256_packs_epi32 (index, index), index);
+    int low  = _mm_cvtsi128_si32 (_mm256_castsi256_si128 (packed));
+    int high = _mm_cvtsi128_si32 (_mm256_extracti128_si256 (packed, 1));
+    memcpy (out + i,     &low,  4);
+    memcpy (out + i + 4, &high, 4);
+  }
+}
+
+AVX2 static inline __m256i upgrade_avx2 (__m256i c)
+{
+  const __m256i c256   = _mm256_set1_epi32 (_COLOR_256);
+  const __m256i hasfg  = _mm256_set1_epi32 (_COLOR_HASFG);
+  const __m256i hasbg  = _mm256_set1_epi32 (_COLOR_HASBG);
+  const __m256i bold   = _mm256_set1_epi32 (_COLOR_BOLD);
+  const __m256i bright = _mm256_set1_epi32 (_COLOR_BRIGHT);
+  const __m256i seven  = _mm256_set1_epi32 (7);
+  const __m256i one    = _mm256_set1_epi32 (1);
+
+  __m256i is256 = _mm256_cmpeq_epi32 (_mm256_and_si256 (c, c256), c256);
+
+  __m256i fg     = _mm256_and_si256 (c, _mm256_set1_epi32 (_COLOR_FG));
+  __m256i bolded = _mm256_cmpeq_epi32 (_mm256_and_si256 (c, bold), bold);
+  __m256i new_fg = select_avx2 (bolded, _mm256_add_epi32 (fg, seven), _mm256_sub_epi32 (fg, one));
+  __m256i c1     = select_avx2 (_mm256_cmpeq_epi32 (_mm256_and_si256 (c, hasfg), hasfg),
+                                _mm256_or_si256 (_mm256_andnot_si256 (_mm256_set1_epi32 (_COLOR_FG | _COLOR_BOLD), c), new_fg),
+                                c);
+
+  __m256i bg       = _mm256_srli_epi32 (_mm256_and_si256 (c1, _mm256_set1_epi32 (_COLOR_BG)), 8);
+  __m256i brighted = _mm256_cmpeq_epi32 (_mm256_and_si256 (c1, bright), bright);
+  __m256i new_bg   = select_avx2 (brighted, _mm256_add_epi32 (bg, seven), _mm256_sub_epi32 (bg, one));
+  __m256i c2       = select_avx2 (_mm256_cmpeq_epi32 (_mm256_and_si256 (c1, hasbg), hasbg),
+                                  _mm256_or_si256 (_mm256_andnot_si256 (_mm256_set1_epi32 (_COLOR_BG | _COLOR_BRIGHT), c1),
+                                                   _mm256_slli_epi32 (new_bg, 8)),
+                                  c1);
+
+  return select_avx2 (is256, c, _mm256_or_si256 (c2, c256));
+}
+
+AVX2 static void upgrade_array_avx2 (const color* in, color* out, size_t count)
+{
+  for (size_t i = 0; i < count; i += 8)
+    _mm256_storeu_si256 ((__m256i*) (out + i),
+                         upgrade_avx2 (_mm256_loadu_si256 ((const __m256i*) (in + i))));
+}
+
+AVX2 static inline __m256i apply_avx2 (__m256i one, __m256i two)
+{
+  const __m256i hasfg = _mm256_set1_epi32 (_COLOR_HASFG);
+  const __m256i hasbg = _mm256_set1_epi32 (_COLOR_HASBG);
+  const __m256i fg    = _mm256_set1_epi32 (_COLOR_FG);
+  const __m256i bg    = _mm256_set1_epi32 (_COLOR_BG);
+
+  one = select_avx2 (_mm256_cmpeq_epi32 (_mm256_and_si256 (two, hasfg), hasfg),
+                     _mm256_or_si256 (_mm256_or_si256 (_mm256_andnot_si256 (fg, one), hasfg), _mm256_and_si256 (two, fg)),
+                     one);
+  one = select_avx2 (_mm256_cmpeq_epi32 (_mm256_and_si256 (two, hasbg), hasbg),
+                     _mm256_or_si256 (_mm256_or_si256 (_mm256_andnot_si256 (bg, one), hasbg), _mm256_and_si256 (two, bg)),
+                     one);
+  return one;
+}
+
+AVX2 static void blend_array_avx2 (const color* a, const color* b, color* out, size_t count)
+{
+  const __m256i invalid = _mm256_set1_epi32 (-1);
+  const __m256i c256    = _mm256_set1_epi32 (_COLOR_256);
+
+  for (size_t i = 0; i < count; i += 8)
+  {
+    __m256i one = _mm256_loadu_si256 ((const __m256i*) (a + i));
+    __m256i two = _mm256_loadu_si256 ((const __m256i*) (b + i));
+
+    __m256i r = _mm256_or_si256 (one, _mm256_and_si256 (two, _mm256_set1_epi32 (_COLOR_UNDERLINE | _COLOR_INVERSE)));
+    __m256i both16 = _mm256_cmpeq_epi32 (_mm256_and_si256 (_mm256_or_si256 (r, two), c256), _mm256_setzero_si256 ());
+
+    __m256i result16  = apply_avx2 (_mm256_or_si256 (r, _mm256_and_si256 (two, _mm256_set1_epi32 (_COLOR_BOLD | _COLOR_BRIGHT))), two);
+    __m256i result256 = apply_avx2 (upgrade_avx2 (r), upgrade_avx2 (two));
+
+    __m256i result = select_avx2 (both16, result16, result256);
+    result = select_avx2 (_mm256_cmpeq_epi32 (two, invalid), one, result);
+    result = select_avx2 (_mm256_cmpeq_epi32 (one, invalid), two, result);
+    _mm256_storeu_si256 ((__m256i*) (out + i), result);
+  }
+}
+
+AVX2 static size_t ascii_prefix_avx2 (const char* text, size_t len)
+{
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32)
+  {
+    unsigned int mask = _mm256_movemask_epi8 (_mm256_loadu_si256 ((const __m256i*) (text + i)));
+    if (mask)
+      return i + __builtin_ctz (mask);
+  }
+
+  return i;
+}
+
+AVX2 static size_t newlines_avx2 (
+  const char* text,
+  size_t len,
+  std::vector <size_t>& ends,
+  std::vector <unsigned char>& ascii,
+  bool& clean)
+{
+  const __m256i newline = _mm256_set1_epi8 ('\n');
+
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32)
+  {
+    __m256i v = _mm256_loadu_si256 ((const __m256i*) (text + i));
+    mark_lines (i, _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (v, newline)),
+                _mm256_movemask_epi8 (v), ends, ascii, clean);
+  }
+
+  return i;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static bool has_avx2 ()
+{
+  static int supported = -1;
+  if (supported == -1)
+    supported = __builtin_cpu_supports ("avx2") ? 1 : 0;
+
+  return supported == 1;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// The vector loops handle whole groups of lanes, and the scalar loops finish
+// the remainder, or everything, if there is no vector support.
+void simd_rgb_index (const int* rgb, unsigned char* out, size_t count)
+{
+  size_t done = 0;
+
+#ifdef HAVE_AVX2
+  if (has_avx2 ())
+  {
+    done = count & ~(size_t) 7;
+    rgb_index_avx2 (rgb, out, done);
+  }
+  else
+#endif
+#ifdef HAVE_SSE2
+  {
+    done = count & ~(size_t) 3;
+    rgb_index_sse2 (rgb, out, done);
+  }
+#endif
+
+  for (size_t i = done; i < count; ++i)
+    out[i] = (unsigned char) color_rgb_index (RGB_COMPONENT (rgb[i], 16),
+                                              RGB_COMPONENT (rgb[i], 8),
+                                              RGB_COMPONENT (rgb[i], 0));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void simd_upgrade (const color* in, color* out, size_t count)
+{
+  size_t done = 0;
+
+#ifdef HAVE_AVX2
+  if (has_avx2 ())
+  {
+    done = count & ~(size_t) 7;
+    upgrade_array_avx2 (in, out, done);
+  }
+  else
+#endif
+#ifdef HAVE_SSE2
+  {
+    done = count & ~(size_t) 3;
+    upgrade_array_sse2 (in, out, done);
+  }
+#endif
+
+  for (size_t i = done; i < count; ++i)
+    out[i] = in[i] == -1 ? -1 : color_upgrade (in[i]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void simd_blend (const color* one, const color* two, color* out, size_t count)
+{
+  size_t done = 0;
+
+#ifdef HAVE_AVX2
+  if (has_avx2 ())
+  {
+    done = count & ~(size_t) 7;
+    blend_array_avx2 (one, two, out, done);
+  }
+  else
+#endif
+#ifdef HAVE_SSE2
+  {
+    done = count & ~(size_t) 3;
+    blend_array_sse2 (one, two, out, done);
+  }
+#endif
+
+  for (size_t i = done; i < count; ++i)
+    out[i] = (one[i] == -1 && two[i] == -1) ? -1 : color_blend (one[i], two[i]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The length of the leading run of ASCII bytes in text.
+size_t simd_ascii_prefix (const char* text, size_t len)
+{
+  size_t i = 0;
+
+#ifdef HAVE_AVX2
+  if (has_avx2 ())
+    i = ascii_prefix_avx2 (text, len);
+  else
+#endif
+#ifdef HAVE_SSE2
+    i = ascii_prefix_sse2 (text, len);
+#endif
+
+  while (i < len && (unsigned char) text[i] < 0x80)
+    ++i;
+
+  return i;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Appends the offset of each newline in text to ends, and whether each line is
+// all ASCII to ascii.  The text after the last newline counts as a line, so
+// ascii gains one more entry than ends.
+void simd_newlines (
+  const char* text,
+  size_t len,
+  std::vector <size_t>& ends,
+  std::vector <unsigned char>& ascii)
+{
+  size_t i = 0;
+  bool clean = true;
+
+#ifdef HAVE_AVX2
+  if (has_avx2 ())
+    i = newlines_avx2 (text, len, ends, ascii, clean);
+  else
+#endif
+#ifdef HAVE_SSE2
+    i = newlines_sse2 (text, len, ends, ascii, clean);
+#endif
+
+  for (; i < len; ++i)
+  {
+    if (text[i] == '\n')
+    {
+      ends.push_back (i);
+      ascii.push_back (clean);
+      clean = true;
+    }
+    else if ((unsigned char) text[i] >= 0x80)
+      clean = false;
+  }
+
+  ascii.push_back (clean);
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -26,51 +26,22 @@
 //
 ////////////////////////////////////////////////////////////////////////////////
 
-#include <iostream>
-#include <stdlib.h>
-#include <vitapi.h>
-
-int main (int argc, char** argv)
-{
-  if (! vapi_initialize ())
-  {
-    vapi_full_screen ();
-
-    int width  = vapi_width ();
-    int height = vapi_height ();
-
-    color palette[] =
-    {
-      color_def ("white on black"),
-      color_def ("white on red"),
-      color_def ("white on blue"),
-      color_def ("white on green"),
-      color_def ("black on magenta"),
-      color_def ("black on cyan"),
-      color_def ("black on yellow"),
-      color_def ("black on white")
-    };
+#ifndef INCLUDED_SIMD
+#define INCLUDED_SIMD
 
-    for (int i = 0; i < 1000; ++i)
-    {
-      vapi_pos_color_text ((rand () % (width - 8)) + 1, (rand () % (height - 1)) + 1, palette [rand () % 8], "VAPIVAPI");
-      vapi_refresh ();
-    }
-
-    for (int i = 0; i < 1000; ++i)
-    {
-      vapi_rectangle ((rand () % (width - 8)) + 1, (rand () % (height - 4)) + 1, 8, 4, palette [rand () % 8]);
-      vapi_refresh ();
-    }
+#include <stddef.h>
+#include <vector>
+#include <vitapi.h>
 
-    vapi_deinitialize ();
-  }
-  else
-    std::cout << "Your $TERM ("
-              << getenv ("TERM")
-              << ") is not supported."
-              << std::endl;
+// Kernels using AVX2 or SSE2 where available, with a scalar fallback.  Each
+// array kernel produces exactly the same results as the corresponding single-
+// value color function.
+void simd_rgb_index (const int*, unsigned char*, size_t);
+void simd_upgrade (const color*, color*, size_t);
+void simd_blend (const color*, const color*, color*, size_t);
+size_t simd_ascii_prefix (const char*, size_t);
+void simd_newlines (const char*, size_t, std::vector <size_t>&, std::vector <unsigned char>&);
 
-  return 0;
-}
+#endif
 
+////////////////////////////////////////////////////////////////////////////////
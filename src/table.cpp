@@ -0,0 +1,241 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <table.h>
+#include <width.h>
+#include <util.h>
+
+#define SAMPLE_ROWS 100          // Rows measured to estimate column widths
+
+static void estimate (table&);
+static int body_height (const table&);
+static void draw_cell (table&, int, int, color, const char*);
+
+////////////////////////////////////////////////////////////////////////////////
+void table_init (
+  table& t,
+  int x,
+  int y,
+  int width,
+  int height,
+  int columns,
+  vapi_cell cell,
+  void* data)
+{
+  t.x        = x;
+  t.y        = y;
+  t.width    = width;
+  t.height   = height;
+  t.columns  = columns;
+  t.cell     = cell;
+  t.data     = data;
+  t.rows     = 0;
+  t.top      = 0;
+  t.body     = 0;
+  t.heading  = 0;
+  t.titled   = false;
+  t.titles.assign (columns, "");
+  t.fixed.assign (columns, 0);
+  t.widths.assign (columns, 0);
+  t.texts.assign (height * columns, "");
+  t.colors.assign (height * columns, 0);
+  t.shown.assign (height, TABLE_UNKNOWN);
+  t.dirty.assign (height, 0);
+  t.estimated = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Forgets what was drawn and the estimated widths, so that the next draw
+// measures, fetches and draws everything again.
+void table_invalidate (table& t)
+{
+  t.estimated = -1;
+  t.shown.assign (t.height, TABLE_UNKNOWN);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Notes that a row has changed in place.  Only a visible row matters, because
+// any other row is fetched when it is scrolled into view.
+void table_changed (table& t, long long row)
+{
+  long long r = row - t.top + (t.titled ? 1 : 0);
+  if (r >= (t.titled ? 1 : 0) && r < t.height)
+    t.dirty[r] = 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Shows a row first, or as near as keeps the rows below filled.
+long long table_scroll (table& t, long long top)
+{
+  t.top = max (min (top, t.rows - body_height (t)), 0LL);
+  return t.top;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draws the cells that differ from those drawn before.  A screen row whose row
+// has not changed is skipped without fetching it.  Otherwise each of its cells
+// is fetched, and drawn if its text or color differs.  The last column takes
+// the rest of the width, and a column is followed by a blank.
+void table_draw (table& t)
+{
+  if (t.estimated == -1 ||
+      t.rows > t.estimated * 2 ||
+      t.rows < t.estimated / 2)
+    estimate (t);
+
+  t.top = max (min (t.top, t.rows - body_height (t)), 0LL);
+
+  int r = 0;
+  if (t.titled)
+  {
+    // The titles are only drawn again when everything is.
+    if (t.shown[0] == TABLE_UNKNOWN)
+      for (int c = 0; c < t.columns; ++c)
+        draw_cell (t, 0, c, t.heading, t.titles[c].c_str ());
+
+    t.shown[0] = TABLE_BLANK;
+    r = 1;
+  }
+
+  for (; r < t.height; ++r)
+  {
+    long long row = t.top + r - (t.titled ? 1 : 0);
+    if (row >= t.rows)
+    {
+      if (t.shown[r] != TABLE_BLANK)
+        for (int c = 0; c < t.columns; ++c)
+          draw_cell (t, r, c, t.body, "");
+
+      t.shown[r] = TABLE_BLANK;
+      continue;
+    }
+
+    if (t.shown[r] == row && ! t.dirty[r])
+      continue;
+
+    bool known = t.shown[r] != TABLE_UNKNOWN;
+    for (int c = 0; c < t.columns; ++c)
+    {
+      color cc = t.body;
+      const char* text = t.cell (row, c, &cc, t.data);
+      if (! text)
+        text = "";
+
+      size_t i = r * t.columns + c;
+      if (! known || t.colors[i] != cc || t.texts[i] != text)
+        draw_cell (t, r, c, cc, text);
+    }
+
+    t.shown[r] = row;
+    t.dirty[r] = 0;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Sets each column to its fixed width, or to the widest of its title and its
+// cells in rows sampled evenly through the table, and the visible rows.  If
+// the widths change, everything is drawn again.
+static void estimate (table& t)
+{
+  std::vector <int> widths (t.columns);
+  for (int c = 0; c < t.columns; ++c)
+    widths[c] = max (utf8_width (t.titles[c].data (), t.titles[c].length ()), 1);
+
+  long long samples = min (t.rows, (long long) SAMPLE_ROWS);
+  for (long long s = 0; s < samples + body_height (t); ++s)
+  {
+    long long row = s < samples
+                  ? (samples > 1 ? s * (t.rows - 1) / (samples - 1) : 0)
+                  : t.top + s - samples;
+    if (row >= t.rows)
+      break;
+
+    for (int c = 0; c < t.columns; ++c)
+    {
+      if (t.fixed[c])
+        continue;
+
+      color cc = t.body;
+      const char* text = t.cell (row, c, &cc, t.data);
+      if (text)
+        widths[c] = max (widths[c], utf8_width (text, strlen (text)));
+    }
+  }
+
+  for (int c = 0; c < t.columns; ++c)
+    if (t.fixed[c])
+      widths[c] = t.fixed[c];
+
+  if (widths != t.widths)
+  {
+    t.widths.swap (widths);
+    t.shown.assign (t.height, TABLE_UNKNOWN);
+  }
+
+  t.estimated = t.rows;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The screen rows that show table rows.
+static int body_height (const table& t)
+{
+  return t.height - (t.titled ? 1 : 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draws a cell at screen row r, clipped and padded to its column, and
+// remembers it.  Columns past the right edge of the table are not drawn.
+static void draw_cell (table& t, int r, int c, color cc, const char* text)
+{
+  int left = 0;
+  for (int i = 0; i < c; ++i)
+    left += t.widths[i] + 1;
+
+  bool last = c == t.columns - 1;
+  int columns = min (last ? t.width - left : t.widths[c] + 1, t.width - left);
+  if (columns > 0)
+  {
+    size_t start;
+    size_t end;
+    int lpad;
+    int rpad;
+    utf8_clip (text, strlen (text), 0, last ? columns : min (columns, t.widths[c]),
+               start, end, lpad, rpad);
+
+    t.pad.assign (text + start, end - start);
+    t.pad.append (max (columns - utf8_width (text + start, end - start), 0), ' ');
+    vapi_pos_color_text_len (t.x + left, t.y + r, cc, t.pad.data (), t.pad.length ());
+  }
+
+  size_t i = r * t.columns + c;
+  t.texts[i] = text;
+  t.colors[i] = cc;
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,75 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDED_TABLE
+#define INCLUDED_TABLE
+
+#include <string>
+#include <vector>
+#include <vitapi.h>
+
+#define TABLE_UNKNOWN -2                 // Screen row contents not known
+#define TABLE_BLANK   -1                 // Screen row below the last row
+
+// A table of many rows, of which only the visible ones are fetched, through
+// a callback, and drawn.  The cells last drawn are remembered, so that only
+// cells that differ are drawn again.
+struct table
+{
+  int x;                                 // Position and size on screen, 1-based
+  int y;
+  int width;
+  int height;
+  int columns;
+  vapi_cell cell;                        // Fetches a cell of a row
+  void* data;                            // Passed to cell
+  long long rows;
+  long long top;                         // First row shown
+  color body;                            // Default color of cells
+  color heading;                         // Color of the titles
+  std::vector <std::string> titles;
+  bool titled;                           // Is the first screen row titles?
+  std::vector <int> fixed;               // Widths set, or 0 to estimate
+  std::vector <int> widths;              // Widths in use
+  long long estimated;                   // Rows when widths were estimated, or -1
+  std::vector <long long> shown;         // Row on each screen row, or TABLE_*
+  std::vector <unsigned char> dirty;     // Has the row on a screen row changed?
+  std::vector <std::string> texts;       // Text drawn in each visible cell
+  std::vector <color> colors;            // Color drawn in each visible cell
+  std::string pad;                       // A cell being drawn, reused
+};
+
+void table_init (table&, int, int, int, int, int, vapi_cell, void*);
+void table_invalidate (table&);
+void table_changed (table&, long long);
+long long table_scroll (table&, long long);
+void table_draw (table&);
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
@@ -28,7 +28,7 @@
 
 #include <map>
 #include <string>
-#include <sstream>
+#include <stdlib.h>
 #include <string.h>
 #include <vitapi.h>
 #include <check.h>
@@ -36,12 +36,13 @@
 static std::string current_term;
 static std::map <std::string, std::string> data;
 
-static std::string lookup (const std::string&);
+static std::map <std::string, std::string> caps; // Decoded current_term caps
+
+static void parse ();
+static const std::string& lookup (const char*);
 static std::string decode (const std::string&);
-static std::string encode (const std::string&, int, int);
-static std::string encode (const std::string&, const std::string&);
-static std::string substitute (const std::string&, const std::string&, const std::string&);
-static std::string substitute (const std::string&, const std::string&, int);
+static size_t expand (const std::string&, char*, size_t, int, int, int, const char*);
+static const char* finish (const char*, const std::string&, char*, size_t, int, int, int, const char*);
 
 ////////////////////////////////////////////////////////////////////////////////
 // Input
@@ -67,12 +68,21 @@ static std::string substitute (const std::string&, const std::string&, int);
 //   Mv:               move to
 //   Alt:              alternate screen buffer
 //   Ttl:              window title
+//   Tc:               supports 24-bit color (from $COLORTERM)
+//   ce:               clear to end of line
+//   ec:               erase characters
+//   rp:               repeat preceding character
+//   ut:               erasing uses the background color
+//   cs:               set scroll region, rows _x_ to _y_
+//   sf, sr:           scroll up, down one line (at the region bottom, top)
+//   SF, SR:           scroll up, down _n_ lines
 //
 // Encoding
 //   _E_               <Escape>
 //   _x_               column
 //   _y_               row
 //   _s_               string
+//   _n_               count
 //   _B_               <Bell>
 extern "C" int tapi_initialize (const char* term)
 {
@@ -86,10 +96,21 @@ extern "C" int tapi_initialize (const char* term)
   std::string normal_mode = "NM:_E_[?1l ";
   std::string mouse       = "Ms1:_E_[?1000h Ms0:_E_[?1000l Mt1:_E_[?1002h Mt0:_E_[?1002l ";
   std::string move        = "Mv:_E_[_y_;_x_H ";
+  std::string clear_eol   = "ce:_E_[K ";
+  std::string scroll      = "cs:_E_[_x_;_y_r sf:\n sr:_E_M ";
+  std::string scroll_n    = "SF:_E_[_n_S SR:_E_[_n_T ";
   std::string alternate   = "Alt:_E_[1049h ";
   std::string title       = "Ttl:_E_]2;_s__B_";   // No trailing space, so last.
 
-  std::string common = app_mode + normal_mode + mouse + move + alternate + title;
+  // 24-bit color support is not implied by the terminal type, but advertised
+  // by the terminal in $COLORTERM.
+  std::string truecolor;
+  const char* colorterm = getenv ("COLORTERM");
+  if (colorterm &&
+      (!strcmp (colorterm, "truecolor") || !strcmp (colorterm, "24bit")))
+    truecolor = "Tc:1 ";
+
+  std::string common = app_mode + normal_mode + mouse + move + clear_eol + scroll + alternate + truecolor + title;
 
   data["vt100"] = data["vt102"] =
     "ku:_E_OA "
@@ -127,6 +148,7 @@ extern "C" int tapi_initialize (const char* term)
     "kP:_E_[5~ "
     "kN:_E_[6~ "
     "cl:_E_[H_E_[J "
+    "ec:_E_[_n_X "
     + common;
 
   data["xterm-color"] =
@@ -150,6 +172,8 @@ extern "C" int tapi_initialize (const char* term)
     "ti:_E_7_E_[?47h "
     "te:_E_[2J_E_[?47l_E_8 "
     "cl:_E_[H_E_[2J "
+    "ec:_E_[_n_X "
+    "ut:1 "
     + common;
 
   data["xterm"] = data["xterm-256color"] =
@@ -176,6 +200,10 @@ extern "C" int tapi_initialize (const char* term)
     "te:_E_[?1049l "
     "hs:1 "
     "cl:_E_[_E_[2J "
+    "ec:_E_[_n_X "
+    "rp:_E_[_n_b "
+    "ut:1 "
+    + scroll_n
     + common;
 
   data["rxvt"] = data["rxvt-unicode"] =
@@ -199,6 +227,9 @@ extern "C" int tapi_initialize (const char* term)
     "ti:_E_[?1049h "
     "te:_E_[r_E_[?1049l "
     "cl:_E_[H_E_[2J "
+    "ec:_E_[_n_X "
+    "ut:1 "
+    + scroll_n
     + common;
 
   data["cygwin"] =
@@ -224,6 +255,8 @@ extern "C" int tapi_initialize (const char* term)
     "cl:_E_[H_E_[J "
     + common;
 
+  parse ();
+
   // Error if term is not supported.
   if (data.find (term) == data.end ())
   {
@@ -242,6 +275,8 @@ extern "C" void tapi_add (const char* term, const char* def)
   CHECK0 (def,  "Null pointer to a terminal definition passed to tapi_add.");
 
   data[term] = def;
+  if (current_term == term)
+    parse ();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -260,7 +295,7 @@ extern "C" const char* tapi_get (const char* key, char* value, size_t size)
     return NULL;
   }
 
-  std::string s = decode (lookup (key));
+  const std::string& s = lookup (key);
 
   if (s.length () + 1 >= size)
   {
@@ -268,7 +303,7 @@ extern "C" const char* tapi_get (const char* key, char* value, size_t size)
     return value;
   }
 
-  strncpy (value, s.c_str (), size);
+  memcpy (value, s.c_str (), s.length () + 1);
   return value;
 }
 
@@ -293,16 +328,8 @@ extern "C" const char* tapi_get_xy (
     return NULL;
   }
 
-  std::string s = encode (decode (lookup (key)), x, y);
-
-  if (s.length () + 1 >= size)
-  {
-    vitapi_set_error ("Insufficient buffer size passed to tapi_get_xy.");
-    return value;
-  }
-
-  strncpy (value, s.c_str (), size);
-  return value;
+  return finish ("Insufficient buffer size passed to tapi_get_xy.",
+                 lookup (key), value, size, x, y, 0, NULL);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -331,99 +358,189 @@ extern "C" const char* tapi_get_str (
     return value;
   }
 
-  std::string s = encode (decode (lookup (key)), str);
+  return finish ("Insufficient buffer size passed to tapi_get_str.",
+                 lookup (key), value, size, 0, 0, 0, str);
+}
 
-  if (s.length () + 1 >= size)
+////////////////////////////////////////////////////////////////////////////////
+// Returns the control string with count substitution, ready to use.
+extern "C" const char* tapi_get_n (
+  const char* key,
+  char* value,
+  size_t size,
+  int n)
+{
+  if (!key)
   {
-    vitapi_set_error ("Insufficient buffer size passed to tapi_get_str.");
-    return value;
+    vitapi_set_error ("Null pointer to a terminal key passed to tapi_get_n.");
+    return NULL;
   }
 
-  strncpy (value, s.c_str (), size);
-  return value;
+  if (!value)
+  {
+    vitapi_set_error ("Null pointer for a key value passed to tapi_get_n.");
+    return NULL;
+  }
+
+  return finish ("Insufficient buffer size passed to tapi_get_n.",
+                 lookup (key), value, size, 0, 0, n, NULL);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Finds current_term in data, then locates the key within the definition.
-static std::string lookup (const std::string& key)
+// Splits the definition of current_term into its keys, and decodes their
+// values once, so that lookups neither search nor allocate, and may be made
+// from several threads.  Keys are whole words followed by ':', so that 'ec' is
+// not found within 'rec:' or '_E_[?1049h', and the first definition of a key
+// is used.
+static void parse ()
 {
-  std::string output;
+  caps.clear ();
+
   std::map <std::string, std::string>::iterator t = data.find (current_term);
-  if (t != data.end ())
+  if (t == data.end ())
+    return;
+
+  const std::string& def = t->second;
+  std::string::size_type start = 0;
+  while (start < def.length ())
   {
-    std::string::size_type k = t->second.find (key);
-    if (k != std::string::npos)
+    std::string::size_type space = def.find (' ', start);
+    if (space == std::string::npos)
+      space = def.length ();
+
+    std::string::size_type colon = def.find (':', start);
+    if (colon != std::string::npos && colon < space)
     {
-      std::string::size_type space = t->second.find (' ', k);
-      if (space != std::string::npos)
-        output = t->second.substr (k + key.length () + 1, space - k - key.length () - 1);
-      else
-        output = t->second.substr (k + key.length () + 1);
+      std::string key = def.substr (start, colon - start);
+      if (caps.find (key) == caps.end ())
+        caps[key] = decode (def.substr (colon + 1, space - colon - 1));
     }
-  }
 
-  return output;
+    start = space + 1;
+  }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Converts "..._E_..." -> "...\033...".
-static std::string decode (const std::string& input)
+// The decoded value of a key for current_term, or an empty string.
+static const std::string& lookup (const char* key)
 {
-  std::string output = input;
-
-  while (output.find ("_E_") != std::string::npos)
-    output = substitute (output, "_E_", "\033");
+  static const std::string none;
 
-  return substitute (output, "_B_", "\007");
+  std::map <std::string, std::string>::const_iterator c = caps.find (key);
+  return c != caps.end () ? c->second : none;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Converts "..._x_..._y_..." -> "...x...y...".
-static std::string encode (const std::string& input, int x, int y)
+// Converts "..._E_..._B_..." -> "...\033...\007...".
+static std::string decode (const std::string& input)
 {
-  return substitute (
-           substitute (input, "_x_", x),
-           "_y_",
-           y);
-}
+  std::string output;
+  for (std::string::size_type i = 0; i < input.length (); ++i)
+  {
+    if (! input.compare (i, 3, "_E_"))
+    {
+      output += '\033';
+      i += 2;
+    }
+    else if (! input.compare (i, 3, "_B_"))
+    {
+      output += '\007';
+      i += 2;
+    }
+    else
+      output += input[i];
+  }
 
-////////////////////////////////////////////////////////////////////////////////
-// Converts "..._s_..." -> "...value...".
-static std::string encode (const std::string& input, const std::string& value)
-{
-  return substitute (input, "_s_", value);
+  return output;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Converts "...FROM..." -> "...TO...".
-static std::string substitute (
+// Copies a control string into value, replacing the first of each of "_x_",
+// "_y_" and "_n_" with a number, and "_s_" with str, if str is given.  Returns
+// the length of the result, which is only written while it fits in size.
+static size_t expand (
   const std::string& input,
-  const std::string& from,
-  const std::string& to)
+  char* value,
+  size_t size,
+  int x,
+  int y,
+  int n,
+  const char* str)
 {
-  std::string::size_type it;
-  if ((it = input.find (from)) != std::string::npos)
-    return input.substr (0, it) + to + input.substr (it + from.length ());
+  static const char* tokens[] = {"_x_", "_y_", "_n_", "_s_"};
+  int numbers[] = {x, y, n};
+  bool done[4] = {false, false, false, str == NULL};
+
+  size_t length = 0;
+  for (std::string::size_type i = 0; i < input.length (); ++i)
+  {
+    int token = 0;
+    while (token < 4 && (done[token] || input.compare (i, 3, tokens[token])))
+      ++token;
+
+    if (token == 4)
+    {
+      if (length < size)
+        value[length] = input[i];
+
+      ++length;
+      continue;
+    }
+
+    done[token] = true;
+    i += 2;
+
+    char digits[16];
+    const char* text = str;
+    if (token < 3)
+    {
+      unsigned int magnitude = numbers[token] < 0 ? 0u - numbers[token] : numbers[token];
+      char* digit = digits + sizeof (digits);
+      *--digit = '\0';
+      do
+      {
+        *--digit = '0' + magnitude % 10;
+        magnitude /= 10;
+      }
+      while (magnitude > 0);
+
+      if (numbers[token] < 0)
+        *--digit = '-';
+
+      text = digit;
+    }
 
-  return input;
+    for (; *text; ++text, ++length)
+      if (length < size)
+        value[length] = *text;
+  }
+
+  return length;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Converts "...FROM..." -> "...TO...".
-static std::string substitute (
+// Expands a control string into value, or if it does not fit, sets the error
+// and leaves value unchanged.
+static const char* finish (
+  const char* error,
   const std::string& input,
-  const std::string& from,
-  int to)
+  char* value,
+  size_t size,
+  int x,
+  int y,
+  int n,
+  const char* str)
 {
-  std::string::size_type it;
-  if ((it = input.find (from)) != std::string::npos)
+  size_t length = expand (input, NULL, 0, x, y, n, str);
+  if (length + 1 >= size)
   {
-    std::stringstream temp;
-    temp << input.substr (0, it) << to << input.substr (it + from.length ());
-    return temp.str ();
+    vitapi_set_error (error);
+    return value;
   }
 
-  return input;
+  expand (input, value, size, x, y, n, str);
+  value[length] = '\0';
+  return value;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -126,3 +126,78 @@ bool digitsOnly (const std::string& input)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
+// Appends a non-negative decimal value, without involving iostreams.
+void appendInt (std::string& output, int value)
+{
+  char digits[16];
+  int count = 0;
+
+  do
+  {
+    digits[count++] = '0' + (value % 10);
+    value /= 10;
+  }
+  while (value > 0 && count < 16);
+
+  while (count > 0)
+    output += digits[--count];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Parses "#rrggbb".
+bool hexTriplet (const std::string& input, int& r, int& g, int& b)
+{
+  if (input.length () != 7 || input[0] != '#')
+    return false;
+
+  int values[6];
+  for (int i = 0; i < 6; ++i)
+  {
+    char c = tolower (input[i + 1]);
+         if (c >= '0' && c <= '9') values[i] = c - '0';
+    else if (c >= 'a' && c <= 'f') values[i] = c - 'a' + 10;
+    else                           return false;
+  }
+
+  r = values[0] * 16 + values[1];
+  g = values[2] * 16 + values[3];
+  b = values[4] * 16 + values[5];
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Appends a value seven bits at a time, low bits first, with the top bit set
+// on every byte but the last.
+void appendVarint (std::string& output, unsigned long long value)
+{
+  while (value >= 0x80)
+  {
+    output += (char) ((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+
+  output += (char) value;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Reads a value written by appendVarint from data[offset], before end, and
+// advances offset past it.
+bool readVarint (
+  const unsigned char* data,
+  size_t end,
+  size_t& offset,
+  unsigned long long& value)
+{
+  value = 0;
+  for (int shift = 0; shift < 64 && offset < end; shift += 7)
+  {
+    unsigned char byte = data[offset++];
+    value |= (unsigned long long) (byte & 0x7F) << shift;
+    if (! (byte & 0x80))
+      return true;
+  }
+
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -48,6 +48,10 @@ std::string trim (const std::string& in, const std::string& t = " ");
 std::string lowerCase (const std::string&);
 int autoComplete (const std::string&, const std::vector<std::string>&, std::vector<std::string>&);
 bool digitsOnly (const std::string&);
+void appendInt (std::string&, int);
+bool hexTriplet (const std::string&, int&, int&, int&);
+void appendVarint (std::string&, unsigned long long);
+bool readVarint (const unsigned char*, size_t, size_t&, unsigned long long&);
 
 #endif
 ////////////////////////////////////////////////////////////////////////////////
@@ -26,8 +26,12 @@
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
 #include <iostream>
-#include <sstream>
+#include <map>
+#include <thread>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -36,260 +40,1396 @@
 #include <vitapi.h>
 #include <check.h>
 #include <util.h>
-
-static std::stringstream output; // Output buffer
+#include <width.h>
+#include <screen.h>
+#include <layer.h>
+#include <drawlist.h>
+#include <writer.h>
+#include <vt.h>
+#include <record.h>
+#include <view.h>
+#include <table.h>
+
+static std::string output;       // Output buffer
 static bool full_screen = false; // Should deinitialize restore?
 static bool has_status  = false; // Terminal has status area
 
+static bool buffered = false;    // Draw into a grid, and refresh the changes
+static grid front;               // What the terminal shows, when buffered
+static grid back;                // What has been drawn, when buffered
+static bool front_known = false; // Does front reflect the terminal?
+static int cursorX = 1;          // Cursor position, when buffered
+static int cursorY = 1;
+
+static std::map <int, layer> layers; // Off-screen layers, by id
+static int selected = 0;         // Layer drawn into, or 0 for the base grid
+static int next_layer = 1;       // Id of the next layer created
+static grid composite;           // The base grid with the layers over it
+static bool composite_known = false; // Is composite up to date, but damage?
+static std::vector <rect> damage; // Screen areas to recompose
+static std::vector <layer*> stack; // Layers being composited, reused
+
+static std::map <int, drawlist> lists; // Recorded draw lists, by id
+static int recording = 0;        // Draw list being recorded, or 0
+static int next_list = 1;        // Id of the next draw list
+static grid tape;                // Grid drawn into while recording
+
+static std::map <int, view> views; // Viewports over mapped files, by id
+static int next_view = 1;        // Id of the next viewport
+
+static std::map <int, table> tables; // Tables of fetched rows, by id
+static int next_table = 1;       // Id of the next table
+
+static int frame_rate = 0;       // Most frames per second, or 0 for no limit
+static bool invalid = false;     // Has a frame been requested?
+static std::chrono::steady_clock::time_point last_frame; // Time of last refresh
+
+static bool record_frames = false; // Are refreshed frames recorded?
+static recorder frame_recorder;  // The recording, when recording frames
+static std::chrono::steady_clock::time_point record_start; // Time of frame 0
+static bool playing = false;     // Is a recording open for playback?
+static player frame_player;      // The recording played back
+
+static bool counting = false;    // Are output statistics counted?
+static vapi_stats stats;         // Output statistics, while counting
+
+static bool headless = false;    // Output to a virtual terminal, not stdout?
+static vt terminal;              // The virtual terminal, when headless
+
 static bool handled = false;     // Latch
 static int screenWidth  = 80;    // Terminal width
 static int screenHeight = 24;    // Terminal height (may include status line)
 
 #define MAX_TAPI_SIZE 64         // Max expected key size.
 
+#define FILL_GLYPHS   0          // Fill by repeating the character
+#define FILL_REPEAT   1          // Fill with the character, then 'rp'
+#define FILL_ERASE    2          // Fill with 'ec'
+#define FILL_EOL      3          // Fill with 'ce'
+
 static void setupSignalHandler ();
 static void restoreSignalHandler ();
 static void getTerminalSize (int&, int&);
 static void handler (int);
-static int utf8_length (const std::string&);
+static grid& base ();
+static grid& canvas ();
+static void touch (int, int, int, int);
+static layer* find_layer (int, const char*);
+static void damage_layer (const layer&);
+static view* find_view (int, const char*);
+static table* find_table (int, const char*);
+static const grid& render ();
+static void show_frame ();
+static void emit (wcolor, const char*, const char*, size_t, const char*);
+static void draw (int, int, const char*, size_t, wcolor, const char*, const char*);
+static bool crop_span (int&, int&, int);
+static bool erasable (color);
+static int choose_fill (int, int, size_t, bool, char*);
+static void emit_fill (int, const char*, size_t, int, const char*);
+
+////////////////////////////////////////////////////////////////////////////////
+// Initialize visual processing.
+extern "C" int vapi_initialize ()
+{
+  output.clear ();
+
+  char* term = getenv ("TERM");
+  if (term)
+  {
+    tapi_initialize (term);
+
+    char hs[MAX_TAPI_SIZE];
+    tapi_get ("hs", hs, MAX_TAPI_SIZE);
+    has_status = strcmp (hs, "") ? true : false;
+
+    char tc[MAX_TAPI_SIZE];
+    tapi_get ("Tc", tc, MAX_TAPI_SIZE);
+    wcolor_set_depth (strcmp (tc, "") ? _COLOR_QUANTIZE_NONE : _COLOR_QUANTIZE_256);
+
+    if (headless)
+      has_status = false;
+    else
+      getTerminalSize (screenWidth, screenHeight);
+
+    setupSignalHandler ();
+    return 0;
+  }
+
+  return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// End of visual processing.
+extern "C" void vapi_deinitialize ()
+{
+  if (full_screen)
+    vapi_end_full_screen ();
+
+  vapi_refresh ();
+  vapi_async (0);
+
+  if (record_frames)
+    vapi_record_stop ();
+
+  vapi_play_close ();
+  while (! views.empty ())
+    vapi_view_close (views.begin ()->first);
+
+  restoreSignalHandler ();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Update the display.  With the writer thread, the output is handed over, and
+// written while the next frame is built.
+extern "C" int vapi_refresh ()
+{
+  invalid = false;
+  last_frame = std::chrono::steady_clock::now ();
+
+  if (buffered)
+  {
+    const grid& drawn = render ();
+    if (record_frames)
+      recorder_frame (frame_recorder, drawn,
+                      std::chrono::duration_cast <std::chrono::microseconds> (
+                        last_frame - record_start).count ());
+  }
+
+  if (output.length ())
+  {
+    std::chrono::steady_clock::time_point start;
+    if (counting)
+      start = std::chrono::steady_clock::now ();
+
+    size_t bytes = output.length ();
+    if (headless)
+      vt_write (terminal, output.data (), output.length ());
+    else if (writer_running ())
+      writer_send (output);
+    else
+      std::cout << output << std::flush;
+
+    output.clear ();
+
+    if (counting)
+    {
+      long long ns = std::chrono::duration_cast <std::chrono::nanoseconds> (
+                       std::chrono::steady_clock::now () - start).count ();
+      ++stats.frames;
+      ++stats.flushes;
+      stats.bytes += bytes;
+      stats.flush_ns += ns;
+      stats.flush_max_ns = max (stats.flush_max_ns, ns);
+      stats.peak_buffer = max (stats.peak_buffer, bytes);
+    }
+
+    return 0;
+  }
+
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Send output to a virtual terminal of w by h cells instead of stdout, or with
+// 0, 0 return to the terminal.  The virtual terminal interprets the output,
+// so that the result can be examined without a tty.  Returns the previous
+// setting.
+extern "C" int vapi_headless (int w, int h)
+{
+  if (w < 0 || h < 0 || (w == 0) != (h == 0))
+  {
+    vitapi_set_error ("Invalid size passed to vapi_headless.");
+    return -1;
+  }
+
+  int previous = headless ? 1 : 0;
+  headless = w > 0;
+  if (headless)
+  {
+    vt_reset (terminal, w, h);
+    screenWidth = w;
+    screenHeight = h;
+    has_status = false;
+  }
+  else
+  {
+    char hs[MAX_TAPI_SIZE] = "";
+    tapi_get ("hs", hs, MAX_TAPI_SIZE);
+    has_status = strcmp (hs, "") ? true : false;
+    getTerminalSize (screenWidth, screenHeight);
+  }
+
+  front_known = false;
+  return previous;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Get the text of row y of the virtual terminal.
+extern "C" const char* vapi_headless_row (int y, char* buf, size_t size)
+{
+  if (! buf)
+  {
+    vitapi_set_error ("Null buffer pointer passed to vapi_headless_row.");
+    return NULL;
+  }
+
+  if (! headless || y < 1 || y > terminal.screen.height)
+  {
+    vitapi_set_error ("Invalid row passed to vapi_headless_row.");
+    return NULL;
+  }
+
+  size_t len = 0;
+  const cell* row = terminal.screen.row (y - 1);
+  for (int x = 0; x < terminal.screen.width; ++x)
+  {
+    if (len + row[x].len + 1 > size)
+    {
+      vitapi_set_error ("Insufficient buffer size passed to vapi_headless_row.");
+      return NULL;
+    }
+
+    memcpy (buf + len, row[x].glyph, row[x].len);
+    len += row[x].len;
+  }
+
+  buf[len] = '\0';
+  return buf;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Get the color of cell [x,y] of the virtual terminal.
+extern "C" wcolor vapi_headless_color (int x, int y)
+{
+  if (! headless ||
+      x < 1 || x > terminal.screen.width ||
+      y < 1 || y > terminal.screen.height)
+  {
+    vitapi_set_error ("Invalid cell passed to vapi_headless_color.");
+    return -1;
+  }
+
+  return terminal.screen.row (y - 1)[x - 1].color;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Get the bytes and control sequences the virtual terminal received since the
+// last call.
+extern "C" void vapi_headless_counts (size_t* bytes, size_t* sequences)
+{
+  if (bytes)
+    *bytes = terminal.bytes;
+
+  if (sequences)
+    *sequences = terminal.sequences;
+
+  terminal.bytes = 0;
+  terminal.sequences = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Limit refreshes made by the scheduler to fps frames per second, or 0 for no
+// limit.  Returns the previous setting.
+extern "C" int vapi_frame_rate (int fps)
+{
+  if (fps < 0)
+  {
+    vitapi_set_error ("Invalid rate passed to vapi_frame_rate.");
+    return -1;
+  }
+
+  int previous = frame_rate;
+  frame_rate = fps;
+  return previous;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Request a frame.  If the frame rate allows, the display is refreshed now,
+// otherwise at the next due vapi_frame_tick.  Requests in between are
+// coalesced into one frame.
+extern "C" void vapi_invalidate ()
+{
+  invalid = true;
+  vapi_frame_tick ();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Refresh the display if a frame was requested and is due.  An event loop
+// calls this when vapi_frame_timeout expires.  Returns 1 if refreshed.
+extern "C" int vapi_frame_tick ()
+{
+  if (! invalid || vapi_frame_timeout () > 0)
+    return 0;
+
+  vapi_refresh ();
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Get the milliseconds until a requested frame is due, suitable as a poll or
+// select timeout, or -1 if no frame was requested.
+extern "C" int vapi_frame_timeout ()
+{
+  if (! invalid)
+    return -1;
+
+  if (frame_rate == 0)
+    return 0;
+
+  std::chrono::steady_clock::time_point due =
+    last_frame + std::chrono::microseconds (1000000 / frame_rate);
+  long long remaining = std::chrono::duration_cast <std::chrono::microseconds>
+                          (due - std::chrono::steady_clock::now ()).count ();
+
+  // Round up, so that a frame is due when the timeout expires.
+  return remaining > 0 ? (int) ((remaining + 999) / 1000) : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Record every refreshed frame to a file, with a keyframe every interval
+// frames, until vapi_record_stop.  Frames are recorded as the cells that
+// changed, so recording switches buffering on.
+extern "C" int vapi_record_start (const char* path, int interval)
+{
+  CHECK1 (path, "Null pointer passed to vapi_record_start.");
+  CHECKW1 (interval, "Invalid keyframe interval passed to vapi_record_start.");
+
+  if (record_frames)
+  {
+    vitapi_set_error ("Frames are already being recorded.");
+    return -1;
+  }
+
+  if (! recorder_open (frame_recorder, path, interval))
+  {
+    vitapi_set_error ("The recording file could not be created.");
+    return -1;
+  }
+
+  vapi_buffered (1);
+  record_frames = true;
+  record_start = std::chrono::steady_clock::now ();
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Stop recording, and finish the file with its index of keyframes.
+extern "C" int vapi_record_stop ()
+{
+  if (! record_frames)
+  {
+    vitapi_set_error ("Frames are not being recorded.");
+    return -1;
+  }
+
+  record_frames = false;
+  if (! recorder_close (frame_recorder))
+  {
+    vitapi_set_error ("The recording file could not be written.");
+    return -1;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Open a recording for playback, which draws its frames into the buffered
+// grid, before the first frame.
+extern "C" int vapi_play_open (const char* path)
+{
+  CHECK1 (path, "Null pointer passed to vapi_play_open.");
+
+  vapi_play_close ();
+  if (! player_open (frame_player, path))
+  {
+    vitapi_set_error ("The recording could not be read.");
+    return -1;
+  }
+
+  vapi_buffered (1);
+  playing = true;
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+extern "C" void vapi_play_close ()
+{
+  if (playing)
+    player_close (frame_player);
+
+  playing = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Get the time of the last frame of the recording, in milliseconds.
+extern "C" long long vapi_play_length ()
+{
+  if (! playing)
+  {
+    vitapi_set_error ("No recording is open for playback.");
+    return -1;
+  }
+
+  return frame_player.length < 0 ? 0 : frame_player.length / 1000;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draw the next frame, and return its time in milliseconds, or -1 at the end.
+extern "C" long long vapi_play_next ()
+{
+  if (! playing)
+  {
+    vitapi_set_error ("No recording is open for playback.");
+    return -1;
+  }
+
+  if (! player_next (frame_player))
+    return -1;
+
+  show_frame ();
+  return frame_player.time / 1000;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draw the frame shown at a time in milliseconds, decoding from the keyframe
+// before it.
+extern "C" int vapi_play_seek (long long ms)
+{
+  if (! playing)
+  {
+    vitapi_set_error ("No recording is open for playback.");
+    return -1;
+  }
+
+  player_seek (frame_player, ms * 1000 + 999);
+  show_frame ();
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Play the rest of the recording, refreshing each frame, at a multiple of the
+// recorded speed, or as fast as possible if speed is 0.
+extern "C" int vapi_play (double speed)
+{
+  if (! playing)
+  {
+    vitapi_set_error ("No recording is open for playback.");
+    return -1;
+  }
+
+  if (speed < 0)
+  {
+    vitapi_set_error ("Invalid speed passed to vapi_play.");
+    return -1;
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  long long from = frame_player.time;
+  long long next;
+  while ((next = player_peek (frame_player)) != -1)
+  {
+    if (from == -1)
+      from = next;
+
+    if (speed > 0)
+      std::this_thread::sleep_until (
+        start + std::chrono::microseconds ((long long) ((next - from) / speed)));
+
+    player_next (frame_player);
+    show_frame ();
+    vapi_refresh ();
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Switch the counting of output statistics on or off, returning the previous
+// setting.  While off, drawing costs no more than a test of the flag.
+extern "C" int vapi_stats_enable (int on)
+{
+  int previous = counting ? 1 : 0;
+  counting = on ? true : false;
+  return previous;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Get the output statistics counted since the last reset.  Flush times are the
+// time vapi_refresh spent handing over output: with the writer thread, that
+// excludes the write itself.
+extern "C" void vapi_stats_get (struct vapi_stats* s)
+{
+  CHECK0 (s, "Null pointer passed to vapi_stats_get.");
+
+  *s = stats;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+extern "C" void vapi_stats_reset ()
+{
+  memset (&stats, 0, sizeof (stats));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Switch the writer thread on or off, returning the previous setting.  When
+// switched off, everything refreshed so far has been written.
+extern "C" int vapi_async (int on)
+{
+  int previous = writer_running () ? 1 : 0;
+  if (on && ! previous)
+  {
+    std::cout << std::flush;
+    if (! writer_start (fileno (stdout)))
+    {
+      vitapi_set_error ("The writer thread could not be started.");
+      return -1;
+    }
+  }
+  else if (! on && previous)
+    writer_stop ();
+
+  return previous;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Discard accumulated but unrefreshed output.
+extern "C" int vapi_discard ()
+{
+  int bytes = output.length ();
+  output.clear ();
+
+  return bytes;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Use the full screen.
+extern "C" void vapi_full_screen ()
+{
+  char ti[MAX_TAPI_SIZE];
+  char alt[MAX_TAPI_SIZE];
+
+  output += tapi_get ("ti", ti, MAX_TAPI_SIZE);
+  output += tapi_get ("Alt", alt, MAX_TAPI_SIZE);
+
+  full_screen = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// End use of full screen.
+extern "C" void vapi_end_full_screen ()
+{
+  char te[MAX_TAPI_SIZE];
+
+  output += tapi_get ("te", te, MAX_TAPI_SIZE);
+
+  full_screen = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Clear the screen.
+extern "C" void vapi_clear ()
+{
+  if (buffered)
+  {
+    grid& g = canvas ();
+    grid_clear (g);
+    touch (0, 0, g.width, g.height);
+    return;
+  }
+
+  char cl[MAX_TAPI_SIZE];
+
+  output += tapi_get ("cl", cl, MAX_TAPI_SIZE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Move cursor.
+extern "C" void vapi_moveto (int x, int y)
+{
+  CHECKX0 (x, "Invalid x coordinate passed to vapi_moveto.");
+  CHECKY0 (y, "Invalid y coordinate passed to vapi_moveto.");
+
+  if (buffered)
+  {
+    cursorX = x;
+    cursorY = y;
+    return;
+  }
+
+  char mv[MAX_TAPI_SIZE];
+  output += tapi_get_xy ("Mv", mv, MAX_TAPI_SIZE, x, y);
+
+  if (counting)
+    ++stats.moves;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draw text at cursor.
+// Note: there is no cropping of text based on location.
+extern "C" void vapi_text (const char* text)
+{
+  CHECK0 (text, "Null pointer passed to vapi_text.");
+
+  emit (0, "", text, strlen (text), "");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draw len bytes of text at cursor.
+extern "C" void vapi_text_len (const char* text, size_t len)
+{
+  CHECK0 (text, "Null pointer passed to vapi_text_len.");
+
+  emit (0, "", text, len, "");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draw colored text at cursor.
+extern "C" void vapi_color_text (color c, const char* text)
+{
+  CHECKC0 (c,    "Invalid color passed to vapi_color_text.");
+  CHECK0  (text, "Null pointer passed to vapi_color_text.");
+
+  emit (wcolor_from_color (c),
+        color_prologue (c, NULL), text, strlen (text), color_epilogue (c, NULL));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draw len bytes of colored text at cursor.
+extern "C" void vapi_color_text_len (color c, const char* text, size_t len)
+{
+  CHECKC0 (c,    "Invalid color passed to vapi_color_text_len.");
+  CHECK0  (text, "Null pointer passed to vapi_color_text_len.");
+
+  emit (wcolor_from_color (c),
+        color_prologue (c, NULL), text, len, color_epilogue (c, NULL));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draw 24-bit colored text at cursor.
+extern "C" void vapi_wcolor_text (wcolor w, const char* text)
+{
+  CHECKC0 (w,    "Invalid color passed to vapi_wcolor_text.");
+  CHECK0  (text, "Null pointer passed to vapi_wcolor_text.");
+
+  emit (w, wcolor_prologue (w, NULL), text, strlen (text), wcolor_epilogue (w, NULL));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draw len bytes of 24-bit colored text at cursor.
+extern "C" void vapi_wcolor_text_len (wcolor w, const char* text, size_t len)
+{
+  CHECKC0 (w,    "Invalid color passed to vapi_wcolor_text_len.");
+  CHECK0  (text, "Null pointer passed to vapi_wcolor_text_len.");
+
+  emit (w, wcolor_prologue (w, NULL), text, len, wcolor_epilogue (w, NULL));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draw text at position.
+// If only part of the string is visible, truncate it.
+extern "C" void vapi_pos_text (int x, int y, const char* text)
+{
+  CHECK0  (text, "Null pointer passed to vapi_pos_text.");
+
+  draw (x, y, text, strlen (text), 0, "", "");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draw len bytes of text at position.
+// If only part of the string is visible, truncate it.
+extern "C" void vapi_pos_text_len (int x, int y, const char* text, size_t len)
+{
+  CHECK0  (text, "Null pointer passed to vapi_pos_text_len.");
+
+  draw (x, y, text, len, 0, "", "");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draw colored text at position
+// If only part of the string is visible, truncate it.
+extern "C" void vapi_pos_color_text (int x, int y, color c, const char* text)
+{
+  CHECKC0 (c,    "Invalid color passed to vapi_pos_color_text.");
+  CHECK0  (text, "Null pointer passed to vapi_pos_color_text.");
+
+  draw (x, y, text, strlen (text), wcolor_from_color (c),
+        color_prologue (c, NULL), color_epilogue (c, NULL));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draw len bytes of colored text at position
+// If only part of the string is visible, truncate it.
+extern "C" void vapi_pos_color_text_len (
+  int x,
+  int y,
+  color c,
+  const char* text,
+  size_t len)
+{
+  CHECKC0 (c,    "Invalid color passed to vapi_pos_color_text_len.");
+  CHECK0  (text, "Null pointer passed to vapi_pos_color_text_len.");
+
+  draw (x, y, text, len, wcolor_from_color (c),
+        color_prologue (c, NULL), color_epilogue (c, NULL));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draw 24-bit colored text at position
+// If only part of the string is visible, truncate it.
+extern "C" void vapi_pos_wcolor_text (int x, int y, wcolor w, const char* text)
+{
+  CHECKC0 (w,    "Invalid color passed to vapi_pos_wcolor_text.");
+  CHECK0  (text, "Null pointer passed to vapi_pos_wcolor_text.");
+
+  draw (x, y, text, strlen (text), w,
+        wcolor_prologue (w, NULL), wcolor_epilogue (w, NULL));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draw len bytes of 24-bit colored text at position
+// If only part of the string is visible, truncate it.
+extern "C" void vapi_pos_wcolor_text_len (
+  int x,
+  int y,
+  wcolor w,
+  const char* text,
+  size_t len)
+{
+  CHECKC0 (w,    "Invalid color passed to vapi_pos_wcolor_text_len.");
+  CHECK0  (text, "Null pointer passed to vapi_pos_wcolor_text_len.");
+
+  draw (x, y, text, len, w, wcolor_prologue (w, NULL), wcolor_epilogue (w, NULL));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Get the number of columns text occupies.
+extern "C" int vapi_text_width (const char* text)
+{
+  CHECK1 (text, "Null pointer passed to vapi_text_width.");
+
+  return utf8_width (text, strlen (text));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draw a colored rectangle, cropping if necessary.
+extern "C" void vapi_rectangle (int x, int y, int w, int h, color c)
+{
+  CHECKC0 (c, "Invalid color passed to vapi_rectangle.");
+  CHECKW0 (w, "Invalid width.");
+  CHECKW0 (h, "Invalid height.");
+
+  // Crop, and don't bother displaying a completely off-screen rectangle.
+  grid* target = buffered ? &canvas () : NULL;
+  if (! crop_span (x, w, target ? target->width  : screenWidth) ||
+      ! crop_span (y, h, target ? target->height : screenHeight))
+    return;
+
+  if (target)
+  {
+    grid_fill (*target, x - 1, y - 1, w, h, wcolor_from_color (c), " ", 1);
+    touch (x - 1, y - 1, w, h);
+    return;
+  }
+
+  char seq[MAX_TAPI_SIZE];
+  int method = choose_fill (x, w, 1, erasable (c), seq);
+
+  // Cursor movement leaves the colors set, so they are only set once.
+  output += color_prologue (c, NULL);
+  for (int i = 0; i < h; ++i)
+  {
+    vapi_moveto (x, y + i);
+    emit_fill (method, " ", 1, w, seq);
+  }
+
+  output += color_epilogue (c, NULL);
+
+  if (counting)
+  {
+    stats.sgr += color_prologue (c, NULL)[0] ? 1 : 0;
+    stats.cells += w * h;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draw a colored horizontal line of a single-column character, cropping if
+// necessary.
+extern "C" void vapi_hline (int x, int y, int w, color c, const char* glyph)
+{
+  CHECKC0 (c,     "Invalid color passed to vapi_hline.");
+  CHECK0  (glyph, "Null pointer passed to vapi_hline.");
+  CHECKW0 (w,     "Invalid width.");
+
+  size_t len = strlen (glyph);
+  if (utf8_width (glyph, len) != 1)
+  {
+    vitapi_set_error ("The character passed to vapi_hline must occupy one column.");
+    return;
+  }
+
+  int h = 1;
+  grid* target = buffered ? &canvas () : NULL;
+  if (! crop_span (x, w, target ? target->width  : screenWidth) ||
+      ! crop_span (y, h, target ? target->height : screenHeight))
+    return;
+
+  if (target)
+  {
+    grid_fill (*target, x - 1, y - 1, w, h, wcolor_from_color (c), glyph, len);
+    touch (x - 1, y - 1, w, h);
+    return;
+  }
+
+  char seq[MAX_TAPI_SIZE];
+  int method = choose_fill (x, w, len, !strcmp (glyph, " ") && erasable (c), seq);
+
+  vapi_moveto (x, y);
+  output += color_prologue (c, NULL);
+  emit_fill (method, glyph, len, w, seq);
+  output += color_epilogue (c, NULL);
+
+  if (counting)
+  {
+    stats.sgr += color_prologue (c, NULL)[0] ? 1 : 0;
+    stats.cells += w;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scroll rows top to bottom up by n lines, or down if n is negative.  The
+// exposed rows are blank, and only they need to be drawn.
+extern "C" void vapi_scroll (int top, int bottom, int n)
+{
+  CHECKY0 (top,    "Invalid top row passed to vapi_scroll.");
+  CHECKY0 (bottom, "Invalid bottom row passed to vapi_scroll.");
+
+  if (top > bottom)
+  {
+    vitapi_set_error ("The top row passed to vapi_scroll is below the bottom row.");
+    return;
+  }
+
+  // When buffered, refresh finds the shift and scrolls.
+  if (buffered)
+  {
+    grid& g = canvas ();
+    bottom = min (bottom, g.height);
+    if (top <= bottom)
+    {
+      grid_scroll (g, top - 1, bottom - 1, n);
+      touch (0, top - 1, g.width, bottom - top + 1);
+    }
+
+    return;
+  }
+
+  std::string seq;
+  if (! scroll_sequence (seq, top, bottom, n, screenHeight))
+  {
+    vitapi_set_error ("The terminal does not support scrolling regions.");
+    return;
+  }
+
+  output += seq;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Switch buffered drawing on or off, returning the previous setting.  When
+// buffered, drawing updates a grid of cells, and vapi_refresh writes only the
+// differences from the previous refresh.
+extern "C" int vapi_buffered (int on)
+{
+  int previous = buffered ? 1 : 0;
+  buffered = on ? true : false;
+
+  if (buffered && ! previous)
+  {
+    grid_resize (back, screenWidth, screenHeight);
+    grid_clear (back);
+    front_known = false;
+    composite_known = false;
+  }
+
+  return previous;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Set the number of threads that refresh a buffered frame, in bands of rows,
+// or 0 to use several only for very large frames.  Output is the same however
+// many threads are used.  Returns the previous setting.
+extern "C" int vapi_threads (int count)
+{
+  if (count < 0)
+  {
+    vitapi_set_error ("Invalid count passed to vapi_threads.");
+    return -1;
+  }
+
+  return screen_threads (count);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Create an off-screen layer at [x,y] of w by h cells, composited over the
+// screen in order of z, and then of creation.  Layers are only composited when
+// buffered, so buffering is switched on.  Returns the layer id.
+extern "C" int vapi_layer_create (int x, int y, int w, int h, int z)
+{
+  CHECKW1 (w, "Invalid width.");
+  CHECKW1 (h, "Invalid height.");
+
+  vapi_buffered (1);
+
+  layer& l = layers[next_layer];
+  l.id      = next_layer;
+  l.x       = x - 1;
+  l.y       = y - 1;
+  l.z       = z;
+  l.visible = true;
+  grid_resize (l.cells, w, h);
+  grid_clear (l.cells);
+
+  damage_layer (l);
+  return next_layer++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Destroy a layer, uncovering whatever was beneath it.
+extern "C" void vapi_layer_destroy (int id)
+{
+  layer* l = find_layer (id, "Invalid layer passed to vapi_layer_destroy.");
+  if (! l)
+    return;
+
+  damage_layer (*l);
+  layers.erase (id);
+  if (selected == id)
+    selected = 0;
+
+  // Without layers, refresh works from the base grid alone.
+  if (layers.empty ())
+  {
+    composite_known = false;
+    damage.clear ();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Direct subsequent drawing, and its coordinates, to a layer, or with 0 to the
+// screen.  Returns the previously selected layer.
+extern "C" int vapi_layer_select (int id)
+{
+  if (id && ! find_layer (id, "Invalid layer passed to vapi_layer_select."))
+    return -1;
+
+  int previous = selected;
+  selected = id;
+  return previous;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Move a layer so its top left corner is at [x,y].
+extern "C" void vapi_layer_move (int id, int x, int y)
+{
+  layer* l = find_layer (id, "Invalid layer passed to vapi_layer_move.");
+  if (! l)
+    return;
+
+  damage_layer (*l);
+  l->x = x - 1;
+  l->y = y - 1;
+  damage_layer (*l);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Change the z-order of a layer.  Higher layers cover lower ones.
+extern "C" void vapi_layer_z (int id, int z)
+{
+  layer* l = find_layer (id, "Invalid layer passed to vapi_layer_z.");
+  if (! l)
+    return;
+
+  l->z = z;
+  damage_layer (*l);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Show or hide a layer, without losing its contents.
+extern "C" void vapi_layer_show (int id, int visible)
+{
+  layer* l = find_layer (id, "Invalid layer passed to vapi_layer_show.");
+  if (! l)
+    return;
+
+  l->visible = visible ? true : false;
+  damage_layer (*l);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Start recording a draw list.  Subsequent drawing is recorded instead of
+// drawn, cropped to the canvas, until vapi_list_end.  Draw lists are replayed
+// into the buffer, so buffering is switched on.  Returns the draw list id.
+extern "C" int vapi_list_begin ()
+{
+  if (recording)
+  {
+    vitapi_set_error ("A draw list is already being recorded.");
+    return -1;
+  }
+
+  vapi_buffered (1);
+
+  grid& g = canvas ();
+  drawlist_tape (tape, g.width, g.height);
+  lists[next_list];
+  recording = next_list;
+  return next_list++;
+}
 
 ////////////////////////////////////////////////////////////////////////////////
-// Initialize visual processing.
-extern "C" int vapi_initialize ()
+// Stop recording a draw list, keeping what was drawn as runs of cells.
+extern "C" void vapi_list_end ()
 {
-  output.str ("");
-
-  char* term = getenv ("TERM");
-  if (term)
-  {
-    tapi_initialize (term);
+  CHECK0 (recording, "No draw list is being recorded.");
 
-    char hs[MAX_TAPI_SIZE];
-    tapi_get ("hs", hs, MAX_TAPI_SIZE);
-    has_status = strcmp (hs, "") ? true : false;
+  drawlist_record (lists[recording], tape);
+  recording = 0;
+  tape.cells.clear ();
+}
 
-    getTerminalSize (screenWidth, screenHeight);
-    setupSignalHandler ();
-    return 0;
+////////////////////////////////////////////////////////////////////////////////
+// Replay a draw list, offset by dx columns and dy rows from where it was
+// recorded.  Only cells are copied; no text is measured or colorized again.
+extern "C" void vapi_list_draw (int id, int dx, int dy)
+{
+  std::map <int, drawlist>::iterator l = lists.find (id);
+  if (l == lists.end () || id == recording)
+  {
+    vitapi_set_error ("Invalid draw list passed to vapi_list_draw.");
+    return;
   }
 
-  return -1;
+  drawlist_replay (l->second, canvas (), dx, dy);
+  for (size_t i = 0; i < l->second.runs.size (); ++i)
+  {
+    const run& r = l->second.runs[i];
+    touch (r.x + dx - 1, r.y + dy, r.count + 2, 1);
+  }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// End of visual processing.
-extern "C" void vapi_deinitialize ()
+// Destroy a draw list.
+extern "C" void vapi_list_destroy (int id)
 {
-  if (full_screen)
-    vapi_end_full_screen ();
-
-  vapi_refresh ();
-  restoreSignalHandler ();
+  if (id == recording || ! lists.erase (id))
+    vitapi_set_error ("Invalid draw list passed to vapi_list_destroy.");
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Update the display.
-extern "C" int vapi_refresh ()
+// Show a file in a viewport of w by h cells at [x,y], from its first line.  The
+// file is mapped, not read, and its lines are indexed on a thread while it is
+// shown.  Returns the viewport id.
+extern "C" int vapi_view_open (const char* path, int x, int y, int w, int h)
 {
-  if (output.str ().size ())
+  CHECK1 (path, "Null pointer passed to vapi_view_open.");
+  CHECKW1 (w, "Invalid width.");
+  CHECKW1 (h, "Invalid height.");
+
+  view& v = views[next_view];
+  if (! view_open (v, path))
   {
-    std::cout << output.str () << std::flush;
-    output.str ("");
-    return 0;
+    views.erase (next_view);
+    vitapi_set_error ("The file could not be mapped.");
+    return -1;
   }
 
-  return 1;
+  v.x      = x;
+  v.y      = y;
+  v.width  = w;
+  v.height = h;
+  return next_view++;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Discard accumulated but unrefreshed output.
-extern "C" int vapi_discard ()
+// Close a viewport, and unmap its file.
+extern "C" void vapi_view_close (int id)
 {
-  int bytes = output.str ().size ();
-  output.str ("");
+  view* v = find_view (id, "Invalid viewport passed to vapi_view_close.");
+  if (! v)
+    return;
 
-  return bytes;
+  view_close (*v);
+  views.erase (id);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Use the full screen.
-extern "C" void vapi_full_screen ()
+// Get the number of lines indexed so far.  If complete is given, it is set to
+// 1 when the whole file is indexed.
+extern "C" long long vapi_view_lines (int id, int* complete)
 {
-  char ti[MAX_TAPI_SIZE];
-  char alt[MAX_TAPI_SIZE];
+  view* v = find_view (id, "Invalid viewport passed to vapi_view_lines.");
+  if (! v)
+    return -1;
 
-  output << tapi_get ("ti", ti, MAX_TAPI_SIZE)
-         << tapi_get ("Alt", alt, MAX_TAPI_SIZE);
+  bool all;
+  long long lines = view_lines (*v, all);
+  if (complete)
+    *complete = all;
 
-  full_screen = true;
+  return lines;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// End use of full screen.
-extern "C" void vapi_end_full_screen ()
+// Get the columns occupied by the widest line indexed so far.
+extern "C" int vapi_view_columns (int id)
 {
-  char te[MAX_TAPI_SIZE];
+  view* v = find_view (id, "Invalid viewport passed to vapi_view_columns.");
+  if (! v)
+    return -1;
 
-  output << tapi_get ("te", te, MAX_TAPI_SIZE);
+  return view_widest (*v);
+}
 
-  full_screen = false;
+////////////////////////////////////////////////////////////////////////////////
+// Show a line, counted from 0, at the top of a viewport.  A line that is not
+// indexed yet is not known, so the last indexed line is shown instead.  Returns
+// the line shown.
+extern "C" long long vapi_view_goto (int id, long long line)
+{
+  view* v = find_view (id, "Invalid viewport passed to vapi_view_goto.");
+  if (! v)
+    return -1;
+
+  bool complete;
+  long long lines = view_lines (*v, complete);
+  line = max (min (line, lines - 1), 0LL);
+  v->top = lines ? view_offset (*v, line) : 0;
+  return line;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Clear the screen.
-extern "C" void vapi_clear ()
+// Show the line that holds a byte offset at the top of a viewport.  Returns the
+// line shown, or -1 if it is not indexed yet.
+extern "C" long long vapi_view_seek (int id, long long offset)
 {
-  char cl[MAX_TAPI_SIZE];
+  view* v = find_view (id, "Invalid viewport passed to vapi_view_seek.");
+  if (! v)
+    return -1;
 
-  output << tapi_get ("cl", cl, MAX_TAPI_SIZE);
+  v->top = view_line_start (*v, max (offset, 0LL));
+  return view_line (*v, v->top);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Move cursor.
-extern "C" void vapi_moveto (int x, int y)
+// Scroll a viewport down by a number of lines, or up if negative.  Within the
+// index the line is looked up, and beyond it the file is searched.  Returns the
+// top line, or -1 if it is not indexed yet.
+extern "C" long long vapi_view_scroll (int id, long long rows)
 {
-  CHECKX0 (x, "Invalid x coordinate passed to vapi_moveto.");
-  CHECKY0 (y, "Invalid y coordinate passed to vapi_moveto.");
+  view* v = find_view (id, "Invalid viewport passed to vapi_view_scroll.");
+  if (! v)
+    return -1;
+
+  bool complete;
+  long long lines = view_lines (*v, complete);
+  long long line = view_line (*v, v->top);
+  if (line != -1 && (line + rows < lines || complete))
+  {
+    line = max (min (line + rows, lines - 1), 0LL);
+    v->top = lines ? view_offset (*v, line) : 0;
+    return line;
+  }
 
-  char mv[MAX_TAPI_SIZE];
-  output << tapi_get_xy ("Mv", mv, MAX_TAPI_SIZE, x, y);
+  v->top = view_walk (*v, v->top, rows);
+  return view_line (*v, v->top);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Draw text at cursor.
-// Note: there is no cropping of text based on location.
-extern "C" void vapi_text (const char* text)
+// Get the top line of a viewport, or -1 if it is not indexed yet.
+extern "C" long long vapi_view_top (int id)
 {
-  CHECK0 (text, "Null pointer passed to vapi_text.");
+  view* v = find_view (id, "Invalid viewport passed to vapi_view_top.");
+  if (! v)
+    return -1;
 
-  output << text;
+  return view_line (*v, v->top);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Draw colored text at cursor.
-extern "C" void vapi_color_text (color c, const char* text)
+// Scroll a viewport sideways, so that column left + 1 of each line is shown in
+// its first column.
+extern "C" void vapi_view_left (int id, int left)
 {
-  CHECKC0 (c,    "Invalid color passed to vapi_color_text.");
-  CHECK0  (text, "Null pointer passed to vapi_color_text.");
+  view* v = find_view (id, "Invalid viewport passed to vapi_view_left.");
+  if (v)
+    v->left = max (left, 0);
+}
 
-/*
-  TODO Why does this code not work?
+////////////////////////////////////////////////////////////////////////////////
+// Draw the lines in a viewport, from the top line.  Only these lines are read,
+// and each is clipped to the viewport and padded with blanks.
+extern "C" void vapi_view_draw (int id, color c)
+{
+  view* v = find_view (id, "Invalid viewport passed to vapi_view_draw.");
+  if (! v)
+    return;
 
-  // The longest color sequence is:   ^[ [ 4 ; 5 ; 38 ; 100 m <string> ^[ [ 0 m
-  // That adds up to 13 (prologue) + 4 (epilogue) + 1 (null character) = 18.
-  int safe_size = strlen (text) + 18;
-  char* buf = new char [safe_size];
-  if (buf)
+  size_t offset = v->top;
+  for (int row = 0; row < v->height; ++row)
   {
-    strncpy (buf, text, safe_size);
-    output << color_colorize (buf, safe_size, c);
-    delete [] buf;
+    v->row.clear ();
+    int used = 0;
+    if (offset < v->size)
+    {
+      size_t next = view_line_end (*v, offset);
+      const char* line = v->data + offset;
+      size_t len = next - offset;
+      if (len && line[len - 1] == '\n')
+        --len;
+      if (len && line[len - 1] == '\r')
+        --len;
+
+      size_t start;
+      size_t end;
+      int lpad;
+      int rpad;
+      utf8_clip (line, len, v->left, v->width, start, end, lpad, rpad);
+      v->row.append (lpad, ' ');
+      v->row.append (line + start, end - start);
+      used = lpad + utf8_width (line + start, end - start);
+      offset = next;
+    }
+
+    v->row.append (max (v->width - used, 0), ' ');
+    vapi_pos_color_text_len (v->x, v->y + row, c, v->row.data (), v->row.length ());
   }
-*/
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Create a table of w by h cells at [x,y], with a number of columns.  Rows are
+// not stored: cell is called for the text and color of each cell as it is
+// needed, with the row, the column, a pointer to the cell color, which may be
+// changed, and data.  The text is copied before cell is called again.  Returns
+// the table id.
+extern "C" int vapi_table_create (
+  int x,
+  int y,
+  int w,
+  int h,
+  int columns,
+  vapi_cell cell,
+  void* data)
+{
+  CHECK1 (cell, "Null pointer passed to vapi_table_create.");
+  CHECKW1 (w, "Invalid width.");
+  CHECKW1 (h, "Invalid height.");
+  CHECKW1 (columns, "Invalid number of columns.");
 
-  char buf [4096];
-  strncpy (buf, text, 4096);
-  output << color_colorize (buf, 4096, c);
+  table_init (tables[next_table], x, y, w, h, columns, cell, data);
+  return next_table++;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Draw text at position.
-// If only part of the string is visible, truncate it.
-extern "C" void vapi_pos_text (int x, int y, const char* text)
+// Destroy a table.
+extern "C" void vapi_table_destroy (int id)
 {
-  CHECK0  (text, "Null pointer passed to vapi_pos_text.");
+  if (! tables.erase (id))
+    vitapi_set_error ("Invalid table passed to vapi_table_destroy.");
+}
 
-  // Don't bother displaying off-screen text.
-  int full_len = strlen (text);
-  int len = utf8_length (text);
-  if (y < 1            ||
-      y > screenHeight ||
-      x > screenWidth  ||
-      x + len - 1 < 1)
-    return;
+////////////////////////////////////////////////////////////////////////////////
+// Set the number of rows.  Column widths are estimated again when it has
+// doubled or halved since they were last estimated.
+extern "C" void vapi_table_rows (int id, long long rows)
+{
+  table* t = find_table (id, "Invalid table passed to vapi_table_rows.");
+  if (t)
+    t->rows = max (rows, 0LL);
+}
 
-  // Amount of text that should be truncated off the left or right.
-  int ltrunc = 0;
-  int rtrunc = 0;
+////////////////////////////////////////////////////////////////////////////////
+// Set the title of a column.  When a column has a title, the first row of the
+// table shows the titles.
+extern "C" void vapi_table_title (int id, int column, const char* title)
+{
+  CHECK0 (title, "Null pointer passed to vapi_table_title.");
+  table* t = find_table (id, "Invalid table passed to vapi_table_title.");
+  if (! t)
+    return;
 
-  if (x < 1)
-  {
-    ltrunc = 1 - x;
-    x = 1;
-  }
+  CHECK0 (column >= 0 && column < t->columns, "Invalid column passed to vapi_table_title.");
 
-  if (x + len - 1 > screenWidth)
-    rtrunc = x + len - 1 - screenWidth;
+  t->titles[column] = title;
+  t->titled = false;
+  for (int c = 0; c < t->columns; ++c)
+    t->titled = t->titled || ! t->titles[c].empty ();
 
-  vapi_moveto (x, y);
-  if (ltrunc != 0 ||
-      rtrunc != 0)
-    vapi_text (std::string (text).substr (ltrunc, full_len - ltrunc - rtrunc).c_str ());
-  else
-    vapi_text (text);
+  table_invalidate (*t);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Draw colored text at position
-// If only part of the string is visible, truncate it.
-extern "C" void vapi_pos_color_text (int x, int y, color c, const char* text)
+// Fix the width of a column, or with 0, estimate it from sampled rows.
+extern "C" void vapi_table_width (int id, int column, int width)
 {
-  CHECKC0 (c,    "Invalid color passed to vapi_pos_color_text.");
-  CHECK0  (text, "Null pointer passed to vapi_pos_color_text.");
-
-  // Don't bother displaying off-screen text.
-  int full_len = strlen (text);
-  int len = utf8_length (text);
-  if (y < 1            ||
-      y > screenHeight ||
-      x > screenWidth  ||
-      x + len - 1 < 1)
+  table* t = find_table (id, "Invalid table passed to vapi_table_width.");
+  if (! t)
     return;
 
-  // Amount of text that should be truncated off the left or right.
-  int ltrunc = 0;
-  int rtrunc = 0;
+  CHECK0 (column >= 0 && column < t->columns, "Invalid column passed to vapi_table_width.");
 
-  if (x < 1)
-  {
-    ltrunc = 1 - x;
-    x = 1;
-  }
+  t->fixed[column] = max (width, 0);
+  t->estimated = -1;
+}
 
-  if (x + len - 1 > screenWidth)
-    rtrunc = x + len - 1 - screenWidth;
+////////////////////////////////////////////////////////////////////////////////
+// Set the default color of cells, and the color of the titles.
+extern "C" void vapi_table_colors (int id, color body, color heading)
+{
+  table* t = find_table (id, "Invalid table passed to vapi_table_colors.");
+  if (! t)
+    return;
 
-  vapi_moveto (x, y);
-  if (ltrunc != 0 ||
-      rtrunc != 0)
-    vapi_color_text (
-      c, std::string (text).substr (ltrunc, full_len - ltrunc - rtrunc).c_str ());
-  else
-    vapi_color_text (c, text);
+  t->body = body;
+  t->heading = heading;
+  table_invalidate (*t);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Draw a colored rectangle, cropping if necessary.
-extern "C" void vapi_rectangle (int x, int y, int w, int h, color c)
+// Show a row, counted from 0, first, or as near as keeps the table filled.
+// Returns the first row shown.
+extern "C" long long vapi_table_top (int id, long long row)
 {
-  CHECKC0 (c, "Invalid color passed to vapi_rectangle.");
-  CHECKW0 (w, "Invalid width.");
-  CHECKW0 (h, "Invalid height.");
+  table* t = find_table (id, "Invalid table passed to vapi_table_top.");
+  if (! t)
+    return -1;
 
-  // Don't bother displaying a completely off-screen rectangle.
-  if (x + w < 1 || x > screenWidth || y + h < 1 || y > screenHeight)
-    return;
+  return table_scroll (*t, row);
+}
 
-  // The rectangle is at least partially visible, so crop if necessary.
-  x = min (max (x, 1), screenWidth);
-  y = min (max (y, 1), screenHeight);
-  w = min (max (w, 1), screenWidth - x + 1);
-  h = min (max (h, 1), screenHeight - y + 1);
+////////////////////////////////////////////////////////////////////////////////
+// Note that a row has changed in place, so that its cells are fetched, and
+// those that differ drawn, by the next vapi_table_draw.  With -1, as after
+// sorting or clearing the screen, all rows have changed, and the column widths
+// are estimated again.
+extern "C" void vapi_table_changed (int id, long long row)
+{
+  table* t = find_table (id, "Invalid table passed to vapi_table_changed.");
+  if (! t)
+    return;
 
-  std::string line (w, ' ');
+  if (row == -1)
+    table_invalidate (*t);
+  else
+    table_changed (*t, row);
+}
 
-  for (int i = 0; i < h; ++i)
-    vapi_pos_color_text (x, y + i, c, line.c_str ());
+////////////////////////////////////////////////////////////////////////////////
+// Draw the cells of the visible rows that have changed since the last draw,
+// either because the rows were scrolled, or noted as changed.
+extern "C" void vapi_table_draw (int id)
+{
+  table* t = find_table (id, "Invalid table passed to vapi_table_draw.");
+  if (t)
+    table_draw (*t);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -299,8 +1439,7 @@ extern "C" void vapi_title (const char* title)
   CHECK0 (title, "Null pointer passed to vapi_title.");
 
   char ttl[MAX_TAPI_SIZE];
-  output << tapi_get_str ("Ttl", ttl, MAX_TAPI_SIZE, title)
-         << std::flush;
+  output += tapi_get_str ("Ttl", ttl, MAX_TAPI_SIZE, title);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -363,7 +1502,7 @@ static void getTerminalSize (int& w, int& h)
 ////////////////////////////////////////////////////////////////////////////////
 static void handler (int sig)
 {
-  if (sig == SIGWINCH)
+  if (sig == SIGWINCH && ! headless)
   {
     getTerminalSize (screenWidth, screenHeight);
 //    ungetc (0432, stdin);
@@ -374,22 +1513,354 @@ static void handler (int sig)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-static int utf8_length (const std::string& str)
+// The base grid, beneath any layers, sized to the screen.
+static grid& base ()
+{
+  if (back.width != screenWidth || back.height != screenHeight)
+  {
+    grid_resize (back, screenWidth, screenHeight);
+    front_known = false;
+    composite_known = false;
+  }
+
+  return back;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The grid drawn into when buffered: the draw list being recorded, the
+// selected layer, or the base grid.
+static grid& canvas ()
+{
+  if (recording)
+    return tape;
+
+  if (selected)
+    return layers[selected].cells;
+
+  return base ();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Records that a rectangle of the canvas, in zero-based canvas coordinates,
+// has changed, so that it is recomposed on refresh.
+static void touch (int x, int y, int w, int h)
+{
+  if (layers.empty () || recording)
+    return;
+
+  if (selected)
+  {
+    const layer& l = layers[selected];
+    if (! l.visible)
+      return;
+
+    rect r = {l.x + x, l.y + y, w, h};
+    rect_add (damage, r);
+  }
+  else
+  {
+    rect r = {x, y, w, h};
+    rect_add (damage, r);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static layer* find_layer (int id, const char* message)
+{
+  std::map <int, layer>::iterator l = layers.find (id);
+  if (l == layers.end ())
+  {
+    vitapi_set_error (message);
+    return NULL;
+  }
+
+  return &l->second;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static void damage_layer (const layer& l)
+{
+  rect r = {l.x, l.y, l.cells.width, l.cells.height};
+  rect_add (damage, r);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static view* find_view (int id, const char* message)
+{
+  std::map <int, view>::iterator v = views.find (id);
+  if (v == views.end ())
+  {
+    vitapi_set_error (message);
+    return NULL;
+  }
+
+  return &v->second;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static table* find_table (int id, const char* message)
+{
+  std::map <int, table>::iterator t = tables.find (id);
+  if (t == tables.end ())
+  {
+    vitapi_set_error (message);
+    return NULL;
+  }
+
+  return &t->second;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Adds the changes since the last refresh to the output.  When the terminal
+// contents are unknown, it is cleared first.  With layers, the damaged areas
+// are first recomposed from the base grid and the layers.
+static const grid& render ()
+{
+  grid* source = &base ();
+  if (! layers.empty ())
+  {
+    if (! composite_known)
+    {
+      grid_resize (composite, back.width, back.height);
+      rect whole = {0, 0, back.width, back.height};
+      damage.clear ();
+      damage.push_back (whole);
+      composite_known = true;
+    }
+
+    stack.clear ();
+    for (std::map <int, layer>::iterator l = layers.begin (); l != layers.end (); ++l)
+      stack.push_back (&l->second);
+
+    compose (composite, back, stack, damage);
+    damage.clear ();
+    source = &composite;
+  }
+
+  grid& drawn = *source;
+
+  if (! front_known)
+  {
+    char cl[MAX_TAPI_SIZE] = "";
+    output += tapi_get ("cl", cl, MAX_TAPI_SIZE);
+    grid_resize (front, drawn.width, drawn.height);
+    grid_clear (front);
+    front_known = true;
+  }
+
+  if (counting)
+  {
+    diff_counts counts = {stats.moves, stats.sgr, stats.cells};
+    screen_diff (front, drawn, output, &counts);
+    stats.moves = counts.moves;
+    stats.sgr   = counts.sgr;
+    stats.cells = counts.cells;
+  }
+  else
+    screen_diff (front, drawn, output);
+
+  return drawn;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Copies the frame being played back into the canvas, cropped to it.
+static void show_frame ()
 {
-  int byteLength = str.length ();
-  int charLength = byteLength;
-  const char* data = str.data ();
+  grid& g = canvas ();
+  const grid& frame = frame_player.screen;
+  grid_clear (g);
 
-  // Decrement the number of bytes for each byte that matches 0b10??????
-  // this way only the first byte of any utf8 sequence is counted.
-  for (int i = 0; i < byteLength; i++)
+  int width = min (g.width, frame.width);
+  for (int y = 0; y < min (g.height, frame.height); ++y)
   {
-    // Extract the first two bits and check whether they are 10
-    if ((data[i] & 0xC0) == 0x80)
-      charLength--;
+    std::copy (frame.row (y), frame.row (y) + width, g.row (y));
+    grid_repair (g.row (y), g.width, width - 1);
   }
 
-  return charLength;
+  touch (0, 0, g.width, g.height);
 }
+
+////////////////////////////////////////////////////////////////////////////////
+// Writes text between control sequences, straight into the output buffer, or
+// when buffered, into the grid at the cursor.
+static void emit (
+  wcolor w,
+  const char* prologue,
+  const char* text,
+  size_t len,
+  const char* epilogue)
+{
+  if (buffered)
+  {
+    int end = grid_text (canvas (), cursorX - 1, cursorY - 1, w, text, len);
+    touch (cursorX - 2, cursorY - 1, end - cursorX + 3, 1);
+    cursorX += utf8_width (text, len);
+    return;
+  }
+
+  output += prologue;
+  output.append (text, len);
+  output += epilogue;
+
+  if (counting)
+  {
+    stats.sgr += prologue[0] ? 1 : 0;
+    stats.cells += utf8_width (text, len);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draws the visible columns of text at [x,y], between the given control
+// sequences, or when buffered, into the grid.  Text is cropped at the screen
+// edges by display column, and a double-width character cut by an edge is
+// replaced by a blank.
+static void draw (
+  int x,
+  int y,
+  const char* text,
+  size_t len,
+  wcolor w,
+  const char* prologue,
+  const char* epilogue)
+{
+  if (buffered)
+  {
+    int end = grid_text (canvas (), x - 1, y - 1, w, text, len);
+    touch (x - 2, y - 1, end - x + 3, 1);
+    return;
+  }
+
+  // Don't bother displaying off-screen text.
+  if (y < 1            ||
+      y > screenHeight ||
+      x > screenWidth)
+    return;
+
+  int skip = x < 1 ? 1 - x : 0;
+  size_t start;
+  size_t end;
+  int lpad;
+  int rpad;
+  utf8_clip (text, len, skip, screenWidth - max (x, 1) + 1, start, end, lpad, rpad);
+  if (start == end && lpad == 0 && rpad == 0)
+    return;
+
+  vapi_moveto (max (x, 1), y);
+  output += prologue;
+  for (int i = 0; i < lpad; ++i)
+    output += ' ';
+
+  output.append (text + start, end - start);
+  for (int i = 0; i < rpad; ++i)
+    output += ' ';
+
+  output += epilogue;
+
+  if (counting)
+  {
+    stats.sgr += prologue[0] ? 1 : 0;
+    stats.cells += lpad + utf8_width (text + start, end - start) + rpad;
+  }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
+// Crops the span [pos, pos + len) to [1, limit].  Returns false if nothing
+// remains.
+static bool crop_span (int& pos, int& len, int limit)
+{
+  if (pos < 1)
+  {
+    len -= 1 - pos;
+    pos = 1;
+  }
+
+  len = min (len, limit - pos + 1);
+  return len > 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Erased cells take the background color, but neither underline nor inverse.
+// A background other than the default is only used if the terminal has 'ut'.
+static bool erasable (color c)
+{
+  if (c & (_COLOR_UNDERLINE | _COLOR_INVERSE))
+    return false;
+
+  if (! (c & _COLOR_HASBG))
+    return true;
+
+  char ut[MAX_TAPI_SIZE] = "";
+  return strcmp (tapi_get ("ut", ut, MAX_TAPI_SIZE), "") ? true : false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Chooses the shortest way to fill w cells from column x with a character of
+// len bytes, from those the terminal supports.  Any control sequence needed is
+// stored in seq.
+static int choose_fill (
+  int x,
+  int w,
+  size_t len,
+  bool erase,
+  char* seq)
+{
+  int method = FILL_GLYPHS;
+  size_t best = w * len;
+
+  char rp[MAX_TAPI_SIZE] = "";
+  tapi_get_n ("rp", rp, MAX_TAPI_SIZE, w - 1);
+  if (w > 1 && rp[0] && len + strlen (rp) < best)
+  {
+    method = FILL_REPEAT;
+    best = len + strlen (rp);
+    strcpy (seq, rp);
+  }
+
+  if (erase)
+  {
+    char ec[MAX_TAPI_SIZE] = "";
+    tapi_get_n ("ec", ec, MAX_TAPI_SIZE, w);
+    if (ec[0] && strlen (ec) < best)
+    {
+      method = FILL_ERASE;
+      best = strlen (ec);
+      strcpy (seq, ec);
+    }
+
+    // Clearing to the end of the line only works at the right edge.
+    char ce[MAX_TAPI_SIZE] = "";
+    tapi_get ("ce", ce, MAX_TAPI_SIZE);
+    if (x + w - 1 == screenWidth && ce[0] && strlen (ce) < best)
+    {
+      method = FILL_EOL;
+      best = strlen (ce);
+      strcpy (seq, ce);
+    }
+  }
+
+  return method;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static void emit_fill (
+  int method,
+  const char* glyph,
+  size_t len,
+  int w,
+  const char* seq)
+{
+  if (method == FILL_GLYPHS)
+  {
+    for (int i = 0; i < w; ++i)
+      output.append (glyph, len);
+  }
+  else if (method == FILL_REPEAT)
+  {
+    output.append (glyph, len);
+    output += seq;
+  }
+  else
+    output += seq;
+}
 
+////////////////////////////////////////////////////////////////////////////////
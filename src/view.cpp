@@ -0,0 +1,283 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <view.h>
+#include <util.h>
+
+#define CHUNK       (4 << 20)    // Bytes scanned before lines are added
+#define BLOCK_LINES 65536        // Most lines in a block of the index
+#define MAX_THREADS 4            // Most threads scanning a chunk
+
+static void scan (view*);
+static void add (view&, size_t, size_t, const std::vector <size_t>&, const std::vector <int>&);
+static bool before_first (long long, const line_block&);
+static bool before_base (size_t, const line_block&);
+
+////////////////////////////////////////////////////////////////////////////////
+// Maps the file, and starts indexing its lines.  Only the pages that are read
+// are brought into memory, and the index is the only memory that grows with
+// the file.
+bool view_open (view& v, const char* path)
+{
+  v.data = NULL;
+  v.size = 0;
+  v.top = 0;
+  v.left = 0;
+  v.blocks.clear ();
+  v.lines = 0;
+  v.scanned = 0;
+  v.widest = 0;
+  v.stopping = false;
+
+  int fd = open (path, O_RDONLY);
+  if (fd == -1)
+    return false;
+
+  struct stat s;
+  if (fstat (fd, &s) == -1)
+  {
+    close (fd);
+    return false;
+  }
+
+  if (s.st_size > 0)
+  {
+    void* data = mmap (NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+      close (fd);
+      return false;
+    }
+
+    v.data = (const char*) data;
+    v.size = s.st_size;
+  }
+
+  close (fd);
+
+  v.indexer = std::thread (scan, &v);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Stops the indexer, and unmaps the file.
+void view_close (view& v)
+{
+  v.stopping = true;
+  if (v.indexer.joinable ())
+    v.indexer.join ();
+
+  if (v.data)
+    munmap ((void*) v.data, v.size);
+
+  v.data = NULL;
+  v.size = 0;
+  v.blocks.clear ();
+  v.lines = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The number of lines indexed so far, and whether that is all of them.
+long long view_lines (view& v, bool& complete)
+{
+  std::lock_guard <std::mutex> lock (v.mutex);
+  complete = v.scanned == v.size;
+  return v.lines;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The columns occupied by the widest line indexed so far.
+int view_widest (view& v)
+{
+  std::lock_guard <std::mutex> lock (v.mutex);
+  return v.widest;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The offset of an indexed line, found by binary search of the blocks.
+size_t view_offset (view& v, long long line)
+{
+  std::lock_guard <std::mutex> lock (v.mutex);
+  if (line < 0 || line >= v.lines)
+    return v.size;
+
+  std::vector <line_block>::const_iterator b =
+    std::upper_bound (v.blocks.begin (), v.blocks.end (), line, before_first) - 1;
+  return b->base + b->starts[line - b->first];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The number of the line holding an offset, found by binary search of the
+// blocks and then of the block, or -1 if it is not indexed yet.
+long long view_line (view& v, size_t offset)
+{
+  std::lock_guard <std::mutex> lock (v.mutex);
+  if (v.blocks.empty () || (offset >= v.scanned && v.scanned < v.size))
+    return -1;
+
+  std::vector <line_block>::const_iterator b =
+    std::upper_bound (v.blocks.begin (), v.blocks.end (), offset, before_base) - 1;
+  std::vector <unsigned int>::const_iterator s =
+    std::upper_bound (b->starts.begin (), b->starts.end (), offset - b->base) - 1;
+  return b->first + (s - b->starts.begin ());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The offset of the start of the line holding an offset.
+size_t view_line_start (const view& v, size_t offset)
+{
+  if (offset >= v.size)
+  {
+    if (v.size == 0)
+      return 0;
+
+    offset = v.size - 1;
+  }
+
+  // A line ending is part of the line it ends.
+  if (v.data[offset] == '\n')
+  {
+    if (offset == 0)
+      return 0;
+
+    --offset;
+  }
+
+  const void* newline = memrchr (v.data, '\n', offset + 1);
+  return newline ? (const char*) newline - v.data + 1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Moves from the line starting at offset by a number of lines, without the
+// index, stopping at the first and last lines.
+size_t view_walk (const view& v, size_t offset, long long rows)
+{
+  for (; rows > 0; --rows)
+  {
+    size_t next = view_line_end (v, offset);
+    if (next >= v.size)
+      break;
+
+    offset = next;
+  }
+
+  for (; rows < 0 && offset > 0; ++rows)
+    offset = view_line_start (v, offset - 1);
+
+  return offset;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The offset after the line starting at offset, and its line ending.
+size_t view_line_end (const view& v, size_t offset)
+{
+  if (offset >= v.size)
+    return v.size;
+
+  const void* newline = memchr (v.data + offset, '\n', v.size - offset);
+  return newline ? (const char*) newline - v.data + 1 : v.size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scans the file a chunk at a time, and adds each chunk's lines to the index,
+// so that they can be used while the rest is scanned.  Chunks end after a
+// newline, so that they hold whole lines, and each is scanned in parallel.
+static void scan (view* v)
+{
+  std::vector <size_t> starts;
+  std::vector <int> widths;
+  int threads = max (min ((int) std::thread::hardware_concurrency (), MAX_THREADS), 1);
+
+  size_t offset = 0;
+  while (offset < v->size && ! v->stopping)
+  {
+    size_t end = min (offset + (size_t) CHUNK, v->size);
+    if (end < v->size)
+    {
+      const void* newline = memrchr (v->data + offset, '\n', end - offset);
+      end = newline ? (const char*) newline - v->data + 1 : view_line_end (*v, end);
+    }
+
+    line_scan (v->scanner, v->data + offset, end - offset, threads, starts, widths);
+    add (*v, offset, end, starts, widths);
+    offset = end;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Appends the lines of a chunk to the index, starting a new block when the
+// last one is full, or an offset from its base would not fit.
+static void add (
+  view& v,
+  size_t offset,
+  size_t end,
+  const std::vector <size_t>& starts,
+  const std::vector <int>& widths)
+{
+  std::lock_guard <std::mutex> lock (v.mutex);
+  for (size_t i = 0; i < starts.size (); ++i)
+  {
+    size_t start = offset + starts[i];
+    if (v.blocks.empty () ||
+        v.blocks.back ().starts.size () >= BLOCK_LINES ||
+        start - v.blocks.back ().base > UINT_MAX)
+    {
+      v.blocks.push_back (line_block ());
+      v.blocks.back ().first = v.lines;
+      v.blocks.back ().base = start;
+    }
+
+    line_block& b = v.blocks.back ();
+    b.starts.push_back (start - b.base);
+    v.widest = max (v.widest, widths[i]);
+    ++v.lines;
+  }
+
+  v.scanned = end;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static bool before_first (long long line, const line_block& b)
+{
+  return line < b.first;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static bool before_base (size_t offset, const line_block& b)
+{
+  return offset < b.base;
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,86 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDED_VIEW
+#define INCLUDED_VIEW
+
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <lines.h>
+
+// Line starts are kept in blocks, each as 32-bit offsets from the start of its
+// first line, so that the index takes about four bytes a line.  A block also
+// ends early where an offset would not fit.
+struct line_block
+{
+  long long first;                       // Number of the first line
+  size_t base;                           // Offset of the first line
+  std::vector <unsigned int> starts;     // Line offsets from base
+};
+
+// A memory-mapped file shown a window of lines at a time.  The line index is
+// built on a thread of its own, and grows while the file is viewed.
+struct view
+{
+  const char* data;
+  size_t size;
+  int x;                                 // Position and size on screen, 1-based
+  int y;
+  int width;
+  int height;
+  size_t top;                            // Offset of the top line
+  int left;                              // Columns scrolled off to the left
+  std::string row;                       // A row being drawn, reused
+
+  std::mutex mutex;                      // Guards the index
+  std::vector <line_block> blocks;
+  long long lines;                       // Lines indexed
+  size_t scanned;                        // Bytes indexed
+  int widest;                            // Columns of the widest line indexed
+  line_scanner scanner;                  // Used by the indexer only
+  std::atomic <bool> stopping;
+  std::thread indexer;
+};
+
+bool view_open (view&, const char*);
+void view_close (view&);
+long long view_lines (view&, bool&);
+int view_widest (view&);
+size_t view_offset (view&, long long);
+long long view_line (view&, size_t);
+size_t view_line_start (const view&, size_t);
+size_t view_walk (const view&, size_t, long long);
+size_t view_line_end (const view&, size_t);
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
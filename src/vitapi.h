@@ -77,11 +77,24 @@
 #define _COLOR_BRIGHT    0x00010000     // 16-color bright background attribute
 #define _COLOR_BG        0x0000FF00     // 8-bit background color mask
 #define _COLOR_FG        0x000000FF     // 8-bit foreground color mask
+#define _COLOR_ATTR      0x007F0000     // All attribute bits
 
 #define _COLOR_DEFAULT   0              // Terminal default colors
 
+#define _COLOR_QUANTIZE_NONE 0          // Use 24-bit colors
 #define _COLOR_QUANTIZE_8   8           // Use only 8 colors
 #define _COLOR_QUANTIZE_16  16          // Use only 16 colors
+#define _COLOR_QUANTIZE_256 256         // Use only 256 colors
+#define _COLOR_QUANTIZE_PERCEPTUAL 0x1000 // Nearest by perceived difference
+
+// wcolor - 24-bit color API.  The attribute bits of a color are kept, shifted
+// up by 32 bits.  A fg or bg field holds a 256-color index, unless the
+// corresponding TRUE bit is set, in which case it holds 0xRRGGBB.
+#define _WCOLOR_TRUEBG   0x0200000000000000LL // Background is 24-bit
+#define _WCOLOR_TRUEFG   0x0100000000000000LL // Foreground is 24-bit
+#define _WCOLOR_ATTR     0x007F000000000000LL // Color attribute bits << 32
+#define _WCOLOR_BG       0x0000FFFFFF000000LL // Background field
+#define _WCOLOR_FG       0x0000000000FFFFFFLL // Foreground field
 
 #ifdef __cplusplus
 extern "C"
@@ -95,12 +108,50 @@ color color_def (const char*);           // Parse definition: "red on white"
 const char* color_name (char*, size_t, color); // Convert a color -> description
 const char* color_decode (char*, size_t, color); // Convert a color -> bits
 color color_upgrade (color);             // Convert 16- to 256-color
+int color_upgrade_array (const color*, color*, size_t);
+                                         // Convert many colors to 256-color
 color color_downgrade (color, int);      // Lossy conversion to 8 or 16 colors
+int color_downgrade_array (const color*, color*, size_t, int);
+                                         // Lossy conversion of many colors
 color color_blend (color, color);        // Blend two colors, possible upgrade
+int color_blend_array (const color*, const color*, color*, size_t);
+                                         // Blend many pairs of colors
+int color_rgb_index (int, int, int);     // Nearest 256-color for 24-bit rgb
+int color_rgb_index_array (const int*, unsigned char*, size_t);
+                                         // Nearest 256-colors for many rgb
 const char* color_colorize (char*, size_t, color);
                                          // Colorize a string
+int color_colorize_text (char*, size_t, color, const char*, size_t);
+                                         // Colorize text into a buffer
+const char* color_prologue (color, size_t*); // Control sequence before text
+const char* color_epilogue (color, size_t*); // Control sequence after text
+
+// wcolor - 24-bit color support
+typedef long long wcolor;
+
+wcolor wcolor_def (const char*);         // Parse definition: "#ff8000 on blue"
+wcolor wcolor_from_color (color);        // Widen a color
+color wcolor_to_color (wcolor);          // Quantize to 256 colors
+int wcolor_set_depth (int);              // Colors supported by the terminal
+const char* wcolor_colorize (char*, size_t, wcolor);
+                                         // Colorize a string
+int wcolor_colorize_text (char*, size_t, wcolor, const char*, size_t);
+                                         // Colorize text into a buffer
+const char* wcolor_prologue (wcolor, size_t*); // Control sequence before text
+const char* wcolor_epilogue (wcolor, size_t*); // Control sequence after text
 
 // iapi - input processing API
+struct iapi_latency                      // Input latency, in microseconds
+{
+  size_t events;                         // Keys returned
+  long long decode_p50;                  // Key read to returned
+  long long decode_p99;
+  long long decode_max;
+  long long wait_p50;                    // Key read to iapi_getch called
+  long long wait_p99;
+  long long wait_max;
+};
+
 int  iapi_initialize ();                 // Initialize for processed input
 void iapi_deinitialize ();               // End of processed input
 void iapi_echo ();                       // Enable echo
@@ -118,25 +169,135 @@ int  iapi_mouse_meta ();                 // Meta key?
 int  iapi_mouse_shift ();                // Shift key?
 int  iapi_getch ();                      // Get processed input
 int  iapi_set_delay (int);               // Delay between related keypresses
+void iapi_latency_get (struct iapi_latency*);
+                                         // Get input latency percentiles
+void iapi_latency_reset ();              // Forget recorded input latency
+int  iapi_record_start (const char*);    // Record input to a file
+int  iapi_record_stop ();                // Stop recording input
+int  iapi_replay_file (const char*, int);
+                                         // Replay recorded input from a file
+int  iapi_replay_buffer (const char*, size_t, int);
+                                         // Replay recorded input from memory
+void iapi_replay_stop ();                // Return to reading stdin
 
 // vapi - visual primitives API
+struct vapi_stats                        // Output counted by vapi_stats_enable
+{
+  size_t frames;                         // Refreshes that wrote output
+  size_t bytes;                          // Bytes written
+  size_t moves;                          // Cursor moves
+  size_t sgr;                            // Color changes
+  size_t cells;                          // Cells written
+  size_t flushes;                        // Writes of refreshed output
+  long long flush_ns;                    // Time spent writing
+  long long flush_max_ns;                // Longest write
+  size_t peak_buffer;                    // Largest output buffer, in bytes
+};
+
+typedef const char* (*vapi_cell) (long long, int, color*, void*);
+                                         // Get a table cell's text and color
+
 int  vapi_initialize ();                 // Initialize visual processing
 void vapi_deinitialize ();               // End of visual processing
 int  vapi_refresh ();                    // Update the display
 int  vapi_discard ();                    // Discard accumulated output
+int  vapi_async (int);                   // Write refreshes on a thread
+int  vapi_frame_rate (int);              // Limit scheduled frames per second
+void vapi_invalidate ();                 // Request a frame
+int  vapi_frame_tick ();                 // Refresh if a requested frame is due
+int  vapi_frame_timeout ();              // Milliseconds until a frame is due
+int  vapi_record_start (const char*, int); // Record frames to a file
+int  vapi_record_stop ();                // Stop recording frames
+int  vapi_play_open (const char*);       // Open a recording for playback
+void vapi_play_close ();                 // Close the recording
+long long vapi_play_length ();           // Get the recording length in ms
+long long vapi_play_next ();             // Draw the next recorded frame
+int  vapi_play_seek (long long);         // Draw the frame at a time in ms
+int  vapi_play (double);                 // Play the rest at a speed
+int  vapi_stats_enable (int);            // Count output statistics
+void vapi_stats_get (struct vapi_stats*);
+                                         // Get output statistics
+void vapi_stats_reset ();                // Zero output statistics
 void vapi_full_screen ();                // Use the full screen
 void vapi_end_full_screen ();            // End use of full screen
 void vapi_clear ();                      // Clear the screen
 void vapi_moveto (int, int);             // Move cursor
 void vapi_text (const char*);            // Draw text at cursor
+void vapi_text_len (const char*, size_t);
+                                         // Draw text of known length
 void vapi_color_text (color, const char*);
                                          // Draw colored text at cursor
+void vapi_color_text_len (color, const char*, size_t);
+                                         // Draw colored text of known length
 void vapi_pos_text (int, int, const char*);
                                          // Draw text at position
+void vapi_pos_text_len (int, int, const char*, size_t);
+                                         // Draw text of length at [x,y]
 void vapi_pos_color_text (int, int, color, const char*);
                                          // Draw colored text at position
+void vapi_pos_color_text_len (int, int, color, const char*, size_t);
+                                         // Draw colored text, length, at [x,y]
+void vapi_wcolor_text (wcolor, const char*);
+                                         // Draw 24-bit colored text at cursor
+void vapi_wcolor_text_len (wcolor, const char*, size_t);
+                                         // Draw 24-bit text of known length
+void vapi_pos_wcolor_text (int, int, wcolor, const char*);
+                                         // Draw 24-bit colored text at position
+void vapi_pos_wcolor_text_len (int, int, wcolor, const char*, size_t);
+                                         // Draw 24-bit text of length at [x,y]
 void vapi_rectangle (int, int, int, int, color);
                                          // Draw a colored rectangle
+void vapi_hline (int, int, int, color, const char*);
+                                         // Draw a colored horizontal line
+void vapi_scroll (int, int, int);        // Scroll rows up or down
+int  vapi_buffered (int);                // Draw into a buffer, refresh changes
+int  vapi_threads (int);                 // Threads refreshing a buffered frame
+int  vapi_layer_create (int, int, int, int, int);
+                                         // Create an off-screen layer
+void vapi_layer_destroy (int);           // Destroy a layer
+int  vapi_layer_select (int);            // Draw into a layer, or 0 the screen
+void vapi_layer_move (int, int, int);    // Move a layer
+void vapi_layer_z (int, int);            // Change the z-order of a layer
+void vapi_layer_show (int, int);         // Show or hide a layer
+int  vapi_list_begin ();                 // Start recording a draw list
+void vapi_list_end ();                   // Stop recording a draw list
+void vapi_list_draw (int, int, int);     // Replay a draw list, offset
+void vapi_list_destroy (int);            // Destroy a draw list
+int  vapi_view_open (const char*, int, int, int, int);
+                                         // Show a file in a viewport
+void vapi_view_close (int);              // Close a viewport
+long long vapi_view_lines (int, int*);   // Get the lines indexed so far
+int  vapi_view_columns (int);            // Get the widest line indexed so far
+long long vapi_view_goto (int, long long);
+                                         // Show a line at the top
+long long vapi_view_seek (int, long long);
+                                         // Show the line at a byte offset
+long long vapi_view_scroll (int, long long);
+                                         // Scroll a viewport by lines
+long long vapi_view_top (int);           // Get the top line of a viewport
+void vapi_view_left (int, int);          // Scroll a viewport to a column
+void vapi_view_draw (int, color);        // Draw the lines in a viewport
+int  vapi_table_create (int, int, int, int, int, vapi_cell, void*);
+                                         // Create a table of fetched rows
+void vapi_table_destroy (int);           // Destroy a table
+void vapi_table_rows (int, long long);   // Set the number of rows
+void vapi_table_title (int, int, const char*);
+                                         // Set a column title
+void vapi_table_width (int, int, int);   // Fix a column width, or estimate
+void vapi_table_colors (int, color, color);
+                                         // Set the cell and title colors
+long long vapi_table_top (int, long long);
+                                         // Show a row first
+void vapi_table_changed (int, long long);
+                                         // Note that a row, or all, changed
+void vapi_table_draw (int);              // Draw the cells that changed
+int  vapi_text_width (const char*);      // Get the columns text occupies
+int  vapi_headless (int, int);           // Draw into a virtual terminal
+const char* vapi_headless_row (int, char*, size_t);
+                                         // Get a virtual terminal row
+wcolor vapi_headless_color (int, int);   // Get a virtual terminal cell color
+void vapi_headless_counts (size_t*, size_t*);
+                                         // Get bytes and sequences received
 int  vapi_width ();                      // Get the terminal width
 int  vapi_height ();                     // Get the terminal height
 void vapi_title (const char*);           // Set the terminal title
@@ -151,6 +312,8 @@ const char* tapi_get_xy (const char*, char*, size_t, int, int);
                                          // Get control string with x,y subst
 const char* tapi_get_str (const char*, char*, size_t, const char*);
                                          // Get control string with string subst
+const char* tapi_get_n (const char*, char*, size_t, int);
+                                         // Get control string with count subst
 
 // error messages.
 int vitapi_error (char*, size_t);        // Obtain last error
@@ -159,6 +322,25 @@ int vitapi_error (char*, size_t);        // Obtain last error
 };
 #endif
 
+// C++17 callers may pass std::string_view, or anything convertible to it, to
+// the drawing functions, which then avoid strlen.
+#if defined (__cplusplus) && __cplusplus >= 201703L
+#include <string_view>
+
+inline void vapi_text (std::string_view text)
+  { vapi_text_len (text.data (), text.size ()); }
+inline void vapi_color_text (color c, std::string_view text)
+  { vapi_color_text_len (c, text.data (), text.size ()); }
+inline void vapi_wcolor_text (wcolor w, std::string_view text)
+  { vapi_wcolor_text_len (w, text.data (), text.size ()); }
+inline void vapi_pos_text (int x, int y, std::string_view text)
+  { vapi_pos_text_len (x, y, text.data (), text.size ()); }
+inline void vapi_pos_color_text (int x, int y, color c, std::string_view text)
+  { vapi_pos_color_text_len (x, y, c, text.data (), text.size ()); }
+inline void vapi_pos_wcolor_text (int x, int y, wcolor w, std::string_view text)
+  { vapi_pos_wcolor_text_len (x, y, w, text.data (), text.size ()); }
+#endif
+
 #endif
 
 ////////////////////////////////////////////////////////////////////////////////
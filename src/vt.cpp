@@ -0,0 +1,411 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include <vt.h>
+#include <width.h>
+#include <util.h>
+
+#define VT_GROUND 0              // Text
+#define VT_ESCAPE 1              // After <Escape>
+#define VT_CSI    2              // After <Escape>[
+#define VT_OSC    3              // After <Escape>], until <Bell>
+#define VT_OSC_ESCAPE 4          // <Escape> within OSC, perhaps ending it
+
+static void print (vt&, const char*, size_t);
+static void line_feed (vt&);
+static void reverse_index (vt&);
+static void scroll (vt&, int);
+static void erase (vt&, int, int, int);
+static void csi (vt&, char);
+static void sgr (vt&, const std::vector <int>&);
+static wcolor pen (const vt&);
+
+////////////////////////////////////////////////////////////////////////////////
+// Resets the terminal to a blank screen of the given size.
+void vt_reset (vt& t, int width, int height)
+{
+  t.screen.width = 0;
+  t.screen.height = 0;
+  t.screen.cells.clear ();
+  grid_resize (t.screen, width, height);
+
+  t.x = 0;
+  t.y = 0;
+  t.top = 0;
+  t.bottom = height - 1;
+  t.pen = 0;
+  t.pen_true = 0;
+  t.state = VT_GROUND;
+  t.sequence.clear ();
+  t.glyph.clear ();
+  t.last.clear ();
+  t.bytes = 0;
+  t.sequences = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Interprets output, which may end part way through a sequence or character.
+void vt_write (vt& t, const char* data, size_t len)
+{
+  t.bytes += len;
+
+  for (size_t i = 0; i < len; ++i)
+  {
+    unsigned char c = data[i];
+    switch (t.state)
+    {
+    case VT_GROUND:
+      if (c == 033)
+        t.state = VT_ESCAPE;
+      else if (c == '\n')
+        line_feed (t);
+      else if (c == '\r')
+        t.x = 0;
+      else if (c == '\b')
+        t.x = max (t.x - 1, 0);
+      else if (c >= 0x20 && c != 0x7F)
+      {
+        // Collect a complete UTF-8 character.
+        t.glyph += (char) c;
+        int need = (unsigned char) t.glyph[0] < 0xC0 ? 1
+                 : (unsigned char) t.glyph[0] < 0xE0 ? 2
+                 : (unsigned char) t.glyph[0] < 0xF0 ? 3 : 4;
+        if ((int) t.glyph.length () >= need)
+        {
+          print (t, t.glyph.data (), t.glyph.length ());
+          t.glyph.clear ();
+        }
+      }
+      break;
+
+    case VT_ESCAPE:
+      t.state = VT_GROUND;
+      if (c == '[')
+      {
+        t.state = VT_CSI;
+        t.sequence.clear ();
+      }
+      else if (c == ']')
+        t.state = VT_OSC;
+      else if (c == 033)
+        t.state = VT_ESCAPE;
+      else
+      {
+        if (c == 'M')
+          reverse_index (t);
+
+        ++t.sequences;
+      }
+      break;
+
+    case VT_CSI:
+      // An <Escape> abandons the sequence, and starts another.
+      if (c == 033)
+        t.state = VT_ESCAPE;
+      else if (c >= 0x40 && c <= 0x7E)
+      {
+        csi (t, c);
+        ++t.sequences;
+        t.state = VT_GROUND;
+      }
+      else
+        t.sequence += (char) c;
+      break;
+
+    case VT_OSC:
+      if (c == 007)
+      {
+        ++t.sequences;
+        t.state = VT_GROUND;
+      }
+      else if (c == 033)
+        t.state = VT_OSC_ESCAPE;
+      break;
+
+    // <Escape>\ ends the OSC, otherwise the <Escape> starts another sequence.
+    case VT_OSC_ESCAPE:
+      ++t.sequences;
+      t.state = VT_ESCAPE;
+      if (c == '\\')
+        t.state = VT_GROUND;
+      else
+        --i;
+      break;
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Prints a character at the cursor, wrapping at the right margin, as xterm
+// does, only when the next character is printed.
+static void print (vt& t, const char* glyph, size_t len)
+{
+  size_t i = 0;
+  int w = utf8_char_width (utf8_decode (glyph, len, i));
+
+  // A combining character joins the previous cell.
+  if (w == 0)
+  {
+    int x = t.x - 1;
+    if (x >= 0 && x < t.screen.width)
+    {
+      cell* row = t.screen.row (t.y);
+      cell& owner = row[x].width == 0 && x > 0 ? row[x - 1] : row[x];
+      if (owner.len + len <= sizeof (owner.glyph))
+      {
+        memcpy (owner.glyph + owner.len, glyph, len);
+        owner.len += len;
+      }
+    }
+
+    return;
+  }
+
+  if (t.x + w > t.screen.width)
+  {
+    t.x = 0;
+    line_feed (t);
+  }
+
+  grid_text (t.screen, t.x, t.y, pen (t), glyph, len);
+  t.x += w;
+  t.last.assign (glyph, len);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static void line_feed (vt& t)
+{
+  if (t.y == t.bottom)
+    scroll (t, 1);
+  else if (t.y < t.screen.height - 1)
+    ++t.y;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static void reverse_index (vt& t)
+{
+  if (t.y == t.top)
+    scroll (t, -1);
+  else if (t.y > 0)
+    --t.y;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scrolls the region up by n, or down if n is negative.  Exposed rows take the
+// background of the pen.
+static void scroll (vt& t, int n)
+{
+  grid_scroll (t.screen, t.top, t.bottom, n);
+
+  int count = min (abs (n), t.bottom - t.top + 1);
+  int first = n > 0 ? t.bottom - count + 1 : t.top;
+  for (int y = first; y < first + count; ++y)
+    erase (t, y, 0, t.screen.width);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Erases columns from to to of row y, leaving the background of the pen.
+static void erase (vt& t, int y, int from, int to)
+{
+  from = max (from, 0);
+  to = min (to, t.screen.width);
+  if (y < 0 || y >= t.screen.height || from >= to)
+    return;
+
+  wcolor w = pen (t);
+  wcolor background = (w & (_WCOLOR_BG | _WCOLOR_TRUEBG)) |
+                      (w & ((wcolor) (_COLOR_HASBG | _COLOR_BRIGHT) << 32));
+  if (w & ((wcolor) _COLOR_HASBG << 32))
+    background |= w & ((wcolor) _COLOR_256 << 32);
+
+  grid_fill (t.screen, from, y, to - from, 1, background, " ", 1);
+  cell* row = t.screen.row (y);
+  grid_repair (row, t.screen.width, from - 1);
+  grid_repair (row, t.screen.width, to);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Interprets a complete CSI sequence.  Missing parameters are 0.
+static void csi (vt& t, char final)
+{
+  bool private_mode = ! t.sequence.empty () && t.sequence[0] == '?';
+  std::vector <int>& p = t.params;
+  p.clear ();
+  const char* s = t.sequence.c_str () + (private_mode ? 1 : 0);
+  while (true)
+  {
+    p.push_back (atoi (s));
+    s = strchr (s, ';');
+    if (! s)
+      break;
+
+    ++s;
+  }
+
+  if (private_mode)
+    return;
+
+  int n = max (p[0], 1);
+  int height = t.screen.height;
+  int width = t.screen.width;
+  switch (final)
+  {
+  case 'H':
+  case 'f':
+    t.y = min (max (p[0], 1), height) - 1;
+    t.x = min (max (p.size () > 1 ? p[1] : 0, 1), width) - 1;
+    break;
+
+  case 'A': t.y = max (t.y - n, 0);               break;
+  case 'B': t.y = min (t.y + n, height - 1);      break;
+  case 'C': t.x = min (t.x + n, width - 1);       break;
+  case 'D': t.x = max (min (t.x, width - 1) - n, 0); break;
+  case 'G': t.x = min (n, width) - 1;             break;
+  case 'd': t.y = min (n, height) - 1;            break;
+
+  case 'J':
+    if (p[0] == 0)
+    {
+      erase (t, t.y, t.x, width);
+      for (int y = t.y + 1; y < height; ++y)
+        erase (t, y, 0, width);
+    }
+    else if (p[0] == 1)
+    {
+      for (int y = 0; y < t.y; ++y)
+        erase (t, y, 0, width);
+      erase (t, t.y, 0, t.x + 1);
+    }
+    else
+      for (int y = 0; y < height; ++y)
+        erase (t, y, 0, width);
+    break;
+
+  case 'K':
+         if (p[0] == 0) erase (t, t.y, t.x, width);
+    else if (p[0] == 1) erase (t, t.y, 0, t.x + 1);
+    else                erase (t, t.y, 0, width);
+    break;
+
+  case 'X':
+    erase (t, t.y, t.x, t.x + n);
+    break;
+
+  case 'b':
+    for (int i = 0; i < n && ! t.last.empty (); ++i)
+      print (t, t.last.data (), t.last.length ());
+    break;
+
+  // As in xterm, a region of less than two rows is ignored.
+  case 'r':
+    {
+      int top = min (max (p[0], 1), height) - 1;
+      int bottom = min (p.size () > 1 && p[1] ? p[1] : height, height) - 1;
+      if (top < bottom)
+      {
+        t.top = top;
+        t.bottom = bottom;
+        t.x = 0;
+        t.y = 0;
+      }
+    }
+    break;
+
+  case 'S': scroll (t, n);  break;
+  case 'T': scroll (t, -n); break;
+  case 'm': sgr (t, p);     break;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Rebuilds the color bits that color_prologue and wcolor_prologue encode.
+static void sgr (vt& t, const std::vector <int>& p)
+{
+  for (size_t i = 0; i < p.size (); ++i)
+  {
+    int code = p[i];
+    if (code == 0)
+    {
+      t.pen = 0;
+      t.pen_true = 0;
+    }
+    else if (code == 1) t.pen |= _COLOR_BOLD;
+    else if (code == 4) t.pen |= _COLOR_UNDERLINE;
+    else if (code == 7) t.pen |= _COLOR_INVERSE;
+    else if (code >= 30 && code <= 37)
+      t.pen = (t.pen & ~_COLOR_FG) | _COLOR_HASFG | (code - 29);
+    else if (code >= 40 && code <= 47)
+      t.pen = (t.pen & ~_COLOR_BG) | _COLOR_HASBG | ((code - 39) << 8);
+    else if (code >= 100 && code <= 107)
+      t.pen = (t.pen & ~_COLOR_BG) | _COLOR_HASBG | _COLOR_BRIGHT | ((code - 99) << 8);
+    else if ((code == 38 || code == 48) && i + 2 < p.size () && p[i + 1] == 5)
+    {
+      t.pen |= _COLOR_256;
+      if (code == 38)
+        t.pen = (t.pen & ~_COLOR_FG) | _COLOR_HASFG | (p[i + 2] & 0xFF);
+      else
+        t.pen = (t.pen & ~_COLOR_BG) | _COLOR_HASBG | ((p[i + 2] & 0xFF) << 8);
+      i += 2;
+    }
+    else if ((code == 38 || code == 48) && i + 4 < p.size () && p[i + 1] == 2)
+    {
+      wcolor rgb = ((p[i + 2] & 0xFF) << 16) | ((p[i + 3] & 0xFF) << 8) | (p[i + 4] & 0xFF);
+      if (code == 38)
+      {
+        t.pen |= _COLOR_HASFG;
+        t.pen_true = (t.pen_true & ~(_WCOLOR_FG | _WCOLOR_TRUEFG)) | _WCOLOR_TRUEFG | rgb;
+      }
+      else
+      {
+        t.pen |= _COLOR_HASBG;
+        t.pen_true = (t.pen_true & ~(_WCOLOR_BG | _WCOLOR_TRUEBG)) | _WCOLOR_TRUEBG | (rgb << 24);
+      }
+      i += 4;
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The pen as a wcolor.  24-bit parts replace the corresponding color fields.
+static wcolor pen (const vt& t)
+{
+  wcolor w = wcolor_from_color (t.pen);
+  if (t.pen_true & _WCOLOR_TRUEFG)
+    w = (w & ~_WCOLOR_FG) | (t.pen_true & (_WCOLOR_FG | _WCOLOR_TRUEFG));
+
+  if (t.pen_true & _WCOLOR_TRUEBG)
+    w = (w & ~_WCOLOR_BG) | (t.pen_true & (_WCOLOR_BG | _WCOLOR_TRUEBG));
+
+  return w;
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,61 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDED_VT
+#define INCLUDED_VT
+
+#include <string>
+#include <screen.h>
+
+// An in-process virtual terminal, which interprets the control sequences
+// vitapi emits into a grid of cells, and counts what it was sent.
+struct vt
+{
+  grid screen;
+  int x;                                 // Cursor, zero-based
+  int y;
+  int top;                               // Scroll region, zero-based
+  int bottom;
+  color pen;                             // Current SGR, without 24-bit parts
+  wcolor pen_true;                       // 24-bit parts of the current SGR
+  int state;                             // Parser state
+  std::string sequence;                  // Parameters of the current sequence
+  std::vector <int> params;              // Parsed parameters, reused
+  std::string glyph;                     // Incomplete UTF-8 character
+  std::string last;                      // Last character printed, for 'rp'
+  size_t bytes;                          // Bytes received
+  size_t sequences;                      // Control sequences received
+};
+
+void vt_reset (vt&, int, int);
+void vt_write (vt&, const char*, size_t);
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,415 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <string.h>
+#include <util.h>
+#include <vitapi.h>
+#include <check.h>
+
+#define SGR_EPILOGUE     "\033[0m"     // Resets all attributes
+#define SGR_EPILOGUE_LEN 4
+
+// SGR prologue cache, as for color, but emptied whenever the depth changes.
+struct wsgr
+{
+  std::string prologue;
+  bool        terminate;
+};
+
+static std::map <wcolor, wsgr> wsgr_cache;
+static std::mutex wsgr_mutex;                // Guards wsgr_cache
+static int depth = _COLOR_QUANTIZE_NONE;     // Quantization of emitted colors
+
+static const wsgr& wsgr_lookup (wcolor);
+static void wsgr_build (wcolor, wsgr&);
+static color base_color (wcolor);
+static void append_rgb (std::string&, int);
+
+////////////////////////////////////////////////////////////////////////////////
+// Supports everything color_def does, plus unquantized 24-bit colors:
+//   #rrggbb                   fg 38;2;r;g;b                bg 48;2;r;g;b
+//
+// For example "bold #ff8000 on blue", or "underline on #202020".
+extern "C" wcolor wcolor_def (const char* def)
+{
+  CHECK1 (def, "Null pointer to a color definition passed to wcolor_def.");
+
+  std::string modifiable_spec = def;
+  std::replace (modifiable_spec.begin (), modifiable_spec.end (), '_', ' ');
+
+  std::vector <std::string> words;
+  split (words, modifiable_spec, ' ');
+
+  // Extract the #rrggbb words, and leave the rest to color_def.
+  std::string rest;
+  int true_fg = -1;
+  int true_bg = -1;
+  bool bg = false;
+
+  std::vector <std::string>::iterator it;
+  for (it = words.begin (); it != words.end (); ++it)
+  {
+    std::string word = lowerCase (trim (*it));
+    if (word == "on")
+      bg = true;
+
+    if (word.length () && word[0] == '#')
+    {
+      int r, g, b;
+      if (!hexTriplet (word, r, g, b))
+      {
+        vitapi_set_error ("The color '" + *it + "' is not recognized.");
+        return -1;
+      }
+
+      (bg ? true_bg : true_fg) = (r << 16) | (g << 8) | b;
+    }
+    else
+      rest += *it + " ";
+  }
+
+  color c = color_def (rest.c_str ());
+  if (c == -1)
+    return -1;
+
+  wcolor w = wcolor_from_color (c);
+
+  if (true_fg != -1)
+  {
+    w &= ~_WCOLOR_FG;
+    w |= _WCOLOR_TRUEFG | ((wcolor) _COLOR_HASFG << 32) | true_fg;
+  }
+
+  if (true_bg != -1)
+  {
+    w &= ~_WCOLOR_BG;
+    w |= _WCOLOR_TRUEBG | ((wcolor) _COLOR_HASBG << 32) | ((wcolor) true_bg << 24);
+  }
+
+  return w;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Widen a color.  This is lossless.
+extern "C" wcolor wcolor_from_color (color c)
+{
+  CHECKC1 (c, "Invalid color passed to wcolor_from_color.");
+
+  return  (wcolor) (c & _COLOR_FG)                |
+         ((wcolor) ((c & _COLOR_BG) >> 8) << 24) |
+         ((wcolor) (c & _COLOR_ATTR) << 32);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Narrow a wcolor, quantizing any 24-bit parts to 256 colors.
+extern "C" color wcolor_to_color (wcolor w)
+{
+  CHECKC1 (w, "Invalid color passed to wcolor_to_color.");
+
+  color c = base_color (w);
+
+  if (w & (_WCOLOR_TRUEFG | _WCOLOR_TRUEBG))
+  {
+    // Upgrade the remaining 16-color parts, to match.
+    c = color_upgrade (c);
+
+    if (w & _WCOLOR_TRUEFG)
+    {
+      int fg = w & _WCOLOR_FG;
+      c |= _COLOR_HASFG | color_rgb_index (fg >> 16, (fg >> 8) & 0xFF, fg & 0xFF);
+    }
+
+    if (w & _WCOLOR_TRUEBG)
+    {
+      int bg = (w & _WCOLOR_BG) >> 24;
+      c |= _COLOR_HASBG | (color_rgb_index (bg >> 16, (bg >> 8) & 0xFF, bg & 0xFF) << 8);
+    }
+  }
+
+  return c;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The number of colors the terminal supports, which determines how 24-bit
+// colors are emitted.  One of _COLOR_QUANTIZE_NONE, _COLOR_QUANTIZE_256,
+// _COLOR_QUANTIZE_16 or _COLOR_QUANTIZE_8, the last two optionally with
+// _COLOR_QUANTIZE_PERCEPTUAL.  vapi_initialize sets this from the terminal.
+// Returns the previous value.
+extern "C" int wcolor_set_depth (int quantity)
+{
+  int base = quantity & ~_COLOR_QUANTIZE_PERCEPTUAL;
+  if (! (quantity == _COLOR_QUANTIZE_NONE ||
+         quantity == _COLOR_QUANTIZE_256  ||
+         base     == _COLOR_QUANTIZE_16   ||
+         base     == _COLOR_QUANTIZE_8))
+  {
+    vitapi_set_error ("Invalid depth passed to wcolor_set_depth.");
+    return -1;
+  }
+
+  int old_value = depth;
+  if (quantity != depth)
+  {
+    depth = quantity;
+    std::lock_guard <std::mutex> lock (wsgr_mutex);
+    wsgr_cache.clear ();
+  }
+
+  return old_value;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// As color_colorize, but 24-bit colors are emitted as 38;2;r;g;b / 48;2;r;g;b,
+// or quantized according to wcolor_set_depth.
+extern "C" const char* wcolor_colorize (char* buf, size_t size, wcolor w)
+{
+  if (!buf)
+  {
+    vitapi_set_error ("Null buffer pointer passed to wcolor_colorize.");
+    return NULL;
+  }
+
+  if (w == -1)
+  {
+    vitapi_set_error ("Invalid color passed to wcolor_colorize.");
+    return NULL;
+  }
+
+  const wsgr& s = wsgr_lookup (w);
+  size_t prologue_len = s.prologue.length ();
+  size_t epilogue_len = s.terminate ? SGR_EPILOGUE_LEN : 0;
+  size_t len = strlen (buf);
+
+  if (prologue_len + len + epilogue_len + 1 >= size)
+  {
+    vitapi_set_error ("Insufficient buffer size passed to wcolor_colorize.");
+    return buf;
+  }
+
+  memmove (buf + prologue_len, buf, len);
+  memcpy (buf, s.prologue.data (), prologue_len);
+  memcpy (buf + prologue_len + len, SGR_EPILOGUE, epilogue_len);
+  buf[prologue_len + len + epilogue_len] = '\0';
+  return buf;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// As color_colorize_text.
+extern "C" int wcolor_colorize_text (
+  char* out,
+  size_t size,
+  wcolor w,
+  const char* text,
+  size_t len)
+{
+  if (!out)
+  {
+    vitapi_set_error ("Null buffer pointer passed to wcolor_colorize_text.");
+    return -1;
+  }
+
+  if (!text)
+  {
+    vitapi_set_error ("Null text pointer passed to wcolor_colorize_text.");
+    return -1;
+  }
+
+  if (w == -1)
+  {
+    vitapi_set_error ("Invalid color passed to wcolor_colorize_text.");
+    return -1;
+  }
+
+  const wsgr& s = wsgr_lookup (w);
+  size_t prologue_len = s.prologue.length ();
+  size_t epilogue_len = s.terminate ? SGR_EPILOGUE_LEN : 0;
+  size_t total = prologue_len + len + epilogue_len;
+
+  if (total + 1 > size)
+  {
+    vitapi_set_error ("Insufficient buffer size passed to wcolor_colorize_text.");
+    return -1;
+  }
+
+  memcpy (out, s.prologue.data (), prologue_len);
+  memcpy (out + prologue_len, text, len);
+  memcpy (out + prologue_len + len, SGR_EPILOGUE, epilogue_len);
+  out[total] = '\0';
+  return (int) total;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The control sequence that precedes text in color w.  The returned pointer
+// remains valid until the depth is changed.
+extern "C" const char* wcolor_prologue (wcolor w, size_t* len)
+{
+  if (w == -1)
+  {
+    vitapi_set_error ("Invalid color passed to wcolor_prologue.");
+    return NULL;
+  }
+
+  const wsgr& s = wsgr_lookup (w);
+  if (len)
+    *len = s.prologue.length ();
+
+  return s.prologue.c_str ();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The control sequence that follows text in color w.
+extern "C" const char* wcolor_epilogue (wcolor w, size_t* len)
+{
+  if (w == -1)
+  {
+    vitapi_set_error ("Invalid color passed to wcolor_epilogue.");
+    return NULL;
+  }
+
+  bool terminate = wsgr_lookup (w).terminate;
+  if (len)
+    *len = terminate ? SGR_EPILOGUE_LEN : 0;
+
+  return terminate ? SGR_EPILOGUE : "";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Finds, or lazily builds, the cached control sequences for a color.  Entries
+// are only removed when the depth changes, which must not happen while other
+// threads are drawing.
+static const wsgr& wsgr_lookup (wcolor w)
+{
+  std::lock_guard <std::mutex> lock (wsgr_mutex);
+  std::map <wcolor, wsgr>::iterator it = wsgr_cache.find (w);
+  if (it == wsgr_cache.end ())
+  {
+    it = wsgr_cache.insert (std::make_pair (w, wsgr ())).first;
+    wsgr_build (w, it->second);
+  }
+
+  return it->second;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Colors without 24-bit parts are exactly representable as a color, and so
+// are handed to color_prologue.  Otherwise, unless the terminal is known to
+// support 24-bit color, the color is quantized via the downgrade tables.  The
+// longest sequence is underline inverse fg bg, at 46 bytes.
+static void wsgr_build (wcolor w, wsgr& s)
+{
+  if (! (w & (_WCOLOR_TRUEFG | _WCOLOR_TRUEBG)) ||
+      depth != _COLOR_QUANTIZE_NONE)
+  {
+    color c = wcolor_to_color (w);
+    if ((c & _COLOR_256)                &&
+        depth != _COLOR_QUANTIZE_NONE &&
+        depth != _COLOR_QUANTIZE_256)
+      c = color_downgrade (c, depth) | (c & (_COLOR_UNDERLINE | _COLOR_INVERSE));
+
+    size_t len;
+    s.prologue = color_prologue (c, &len);
+    color_epilogue (c, &len);
+    s.terminate = len > 0;
+    return;
+  }
+
+  // Any remaining 16-color parts are upgraded, to use the same form.
+  color c = color_upgrade (base_color (w));
+
+  s.prologue.reserve (48);
+  s.terminate = true;
+
+  if (c & _COLOR_UNDERLINE)
+    s.prologue += "\033[4m";
+
+  if (c & _COLOR_INVERSE)
+    s.prologue += "\033[7m";
+
+  if (w & _WCOLOR_TRUEFG)
+  {
+    s.prologue += "\033[38;2;";
+    append_rgb (s.prologue, w & _WCOLOR_FG);
+    s.prologue += "m";
+  }
+  else if (c & _COLOR_HASFG)
+  {
+    s.prologue += "\033[38;5;";
+    appendInt (s.prologue, c & _COLOR_FG);
+    s.prologue += "m";
+  }
+
+  if (w & _WCOLOR_TRUEBG)
+  {
+    s.prologue += "\033[48;2;";
+    append_rgb (s.prologue, (w & _WCOLOR_BG) >> 24);
+    s.prologue += "m";
+  }
+  else if (c & _COLOR_HASBG)
+  {
+    s.prologue += "\033[48;5;";
+    appendInt (s.prologue, (c & _COLOR_BG) >> 8);
+    s.prologue += "m";
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The color that remains when the 24-bit parts are removed.
+static color base_color (wcolor w)
+{
+  color c = (color) ((w & _WCOLOR_ATTR) >> 32);
+
+  if (w & _WCOLOR_TRUEFG)
+    c &= ~_COLOR_HASFG;
+  else
+    c |= (color) (w & _COLOR_FG);
+
+  if (w & _WCOLOR_TRUEBG)
+    c &= ~_COLOR_HASBG;
+  else
+    c |= (color) (((w & _WCOLOR_BG) >> 24) << 8);
+
+  return c;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Appends "r;g;b".
+static void append_rgb (std::string& output, int rgb)
+{
+  appendInt (output, rgb >> 16);
+  output += ";";
+  appendInt (output, (rgb >> 8) & 0xFF);
+  output += ";";
+  appendInt (output, rgb & 0xFF);
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,317 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <width.h>
+#include <simd.h>
+#include <util.h>
+
+// Ranges of code points, encoded as (first << 11) | (last - first), generated
+// from the Unicode 14 character database.  Zero-width characters are the
+// nonspacing, enclosing and format characters, and Hangul medial jamo.  Double-
+// width characters are East Asian Wide and Fullwidth, which includes emoji.
+// Planes 2 and 3 are all double-width, and are not listed.
+static const unsigned int zero_width[] =
+{
+  0x0018006F, 0x00241806, 0x002C882C, 0x002DF800, 0x002E0801, 0x002E2001,
+  0x002E3800, 0x00300005, 0x0030800A, 0x0030E000, 0x00325814, 0x00338000,
+  0x0036B007, 0x0036F805, 0x00373801, 0x00375003, 0x00387800, 0x00388800,
+  0x0039801A, 0x003D300A, 0x003F5808, 0x003FE800, 0x0040B003, 0x0040D808,
+  0x00412802, 0x00414804, 0x0042C802, 0x0044800F, 0x00465038, 0x0049D000,
+  0x0049E000, 0x004A0807, 0x004A6800, 0x004A8806, 0x004B1001, 0x004C0800,
+  0x004DE000, 0x004E0803, 0x004E6800, 0x004F1001, 0x004FF004, 0x0051E000,
+  0x00520810, 0x00538001, 0x0053A800, 0x00540801, 0x0055E000, 0x00560807,
+  0x00566800, 0x00571001, 0x0057D007, 0x0059E000, 0x0059F800, 0x005A0803,
+  0x005A6809, 0x005B1001, 0x005C1000, 0x005E0000, 0x005E6800, 0x00600000,
+  0x00602000, 0x0061E000, 0x0061F002, 0x00623010, 0x00631001, 0x00640800,
+  0x0065E000, 0x0065F800, 0x00663000, 0x00666001, 0x00671001, 0x00680001,
+  0x0069D801, 0x006A0803, 0x006A6800, 0x006B1001, 0x006C0800, 0x006E5000,
+  0x006E9004, 0x00718800, 0x0071A006, 0x00723807, 0x00758800, 0x0075A008,
+  0x00764005, 0x0078C001, 0x0079A800, 0x0079B800, 0x0079C800, 0x007B880D,
+  0x007C0004, 0x007C3001, 0x007C682F, 0x007E3000, 0x00816803, 0x00819005,
+  0x0081C801, 0x0081E801, 0x0082C001, 0x0082F002, 0x00838803, 0x00841000,
+  0x00842801, 0x00846800, 0x0084E800, 0x008B009F, 0x009AE802, 0x00B89002,
+  0x00B99001, 0x00BA9001, 0x00BB9001, 0x00BDA001, 0x00BDB806, 0x00BE3000,
+  0x00BE480A, 0x00BEE800, 0x00C05804, 0x00C42801, 0x00C54800, 0x00C90002,
+  0x00C93801, 0x00C99000, 0x00C9C802, 0x00D0B801, 0x00D0D800, 0x00D2B000,
+  0x00D2C008, 0x00D31000, 0x00D32807, 0x00D3980C, 0x00D58053, 0x00D9A000,
+  0x00D9B004, 0x00D9E000, 0x00DA1000, 0x00DB5808, 0x00DC0001, 0x00DD1003,
+  0x00DD4001, 0x00DD5802, 0x00DF3000, 0x00DF4001, 0x00DF6800, 0x00DF7802,
+  0x00E16007, 0x00E1B001, 0x00E68002, 0x00E6A00C, 0x00E71006, 0x00E76800,
+  0x00E7A000, 0x00E7C001, 0x00EE003F, 0x01005804, 0x01015004, 0x0103000F,
+  0x01068020, 0x01677802, 0x016BF800, 0x016F001F, 0x01815003, 0x0184C801,
+  0x05337803, 0x0533A009, 0x0534F001, 0x05378001, 0x05401000, 0x05403000,
+  0x05405800, 0x05412801, 0x05416000, 0x05462001, 0x05470011, 0x0547F800,
+  0x05493007, 0x054A380A, 0x054C0002, 0x054D9800, 0x054DB003, 0x054DE001,
+  0x054F2800, 0x05514805, 0x05518801, 0x0551A801, 0x05521800, 0x05526000,
+  0x0553E000, 0x05558000, 0x05559002, 0x0555B801, 0x0555F001, 0x05560800,
+  0x05576001, 0x0557B000, 0x055F2800, 0x055F4000, 0x055F6800, 0x07D8F000,
+  0x07F0000F, 0x07F1000F, 0x07F7F800, 0x07FFC802, 0x080FE800, 0x08170000,
+  0x081BB004, 0x0850080E, 0x0851C007, 0x08572801, 0x08692003, 0x08755801,
+  0x087A300A, 0x087C1003, 0x08800800, 0x0881C00E, 0x08838000, 0x08839801,
+  0x0883F802, 0x08859803, 0x0885C801, 0x0885E800, 0x0886100B, 0x08880002,
+  0x08893804, 0x08896807, 0x088B9800, 0x088C0001, 0x088DB008, 0x088E4803,
+  0x088E7800, 0x08917802, 0x0891A000, 0x0891B001, 0x0891F000, 0x0896F800,
+  0x08971807, 0x08980001, 0x0899D801, 0x089A0000, 0x089B300E, 0x08A1C007,
+  0x08A21002, 0x08A23000, 0x08A2F000, 0x08A59805, 0x08A5D000, 0x08A5F801,
+  0x08A61001, 0x08AD9003, 0x08ADE001, 0x08ADF801, 0x08AEE001, 0x08B19807,
+  0x08B1E800, 0x08B1F801, 0x08B55800, 0x08B56800, 0x08B58005, 0x08B5B800,
+  0x08B8E802, 0x08B91003, 0x08B93804, 0x08C17808, 0x08C1C801, 0x08C9D801,
+  0x08C9F000, 0x08CA1800, 0x08CEA007, 0x08CF0000, 0x08D00809, 0x08D19805,
+  0x08D1D803, 0x08D23800, 0x08D28805, 0x08D2C802, 0x08D4500C, 0x08D4C001,
+  0x08E1800D, 0x08E1F800, 0x08E49015, 0x08E55006, 0x08E59001, 0x08E5A801,
+  0x08E98814, 0x08EA3800, 0x08EC8001, 0x08ECA800, 0x08ECB800, 0x08F79801,
+  0x09A18008, 0x0B578004, 0x0B598006, 0x0B7A7800, 0x0B7C7803, 0x0B7F2000,
+  0x0DE4E801, 0x0DE507FF, 0x0E2507FF, 0x0E6502A6, 0x0E8B3802, 0x0E8B980F,
+  0x0E8C2806, 0x0E8D5003, 0x0E921002, 0x0ED00036, 0x0ED1D831, 0x0ED3A800,
+  0x0ED42000, 0x0ED4D814, 0x0F00002A, 0x0F098006, 0x0F157000, 0x0F176003,
+  0x0F468006, 0x0F4A2006, 0x700009EE
+};
+
+static const unsigned int double_width[] =
+{
+  0x0088005F, 0x0118D001, 0x01194801, 0x011F4803, 0x011F8000, 0x011F9800,
+  0x012FE801, 0x0130A001, 0x0132400B, 0x0133F800, 0x01349800, 0x01350800,
+  0x01355001, 0x0135E801, 0x01362001, 0x01367000, 0x0136A000, 0x01375000,
+  0x01379001, 0x0137A800, 0x0137D000, 0x0137E800, 0x01382800, 0x01385001,
+  0x01394000, 0x013A6000, 0x013A7000, 0x013A9802, 0x013AB800, 0x013CA802,
+  0x013D8000, 0x013DF800, 0x0158D801, 0x015A8000, 0x015AA800, 0x017401A9,
+  0x01817010, 0x01820855, 0x0184D9AC, 0x019287FF, 0x01D287FF, 0x021287FF,
+  0x0252836F, 0x027007FF, 0x02B007FF, 0x02F007FF, 0x033007FF, 0x037007FF,
+  0x03B007FF, 0x03F007FF, 0x043007FF, 0x047007FF, 0x04B007FF, 0x04F006C6,
+  0x054B001C, 0x056007FF, 0x05A007FF, 0x05E007FF, 0x062007FF, 0x066007FF,
+  0x06A003A3, 0x07C801D9, 0x07F08009, 0x07F1803B, 0x07F8085F, 0x07FF0006,
+  0x0B7F0003, 0x0B7F87FF, 0x0BBF87FF, 0x0BFF87FF, 0x0C3F87FF, 0x0C7F87FF,
+  0x0CBF87FF, 0x0CFF87FF, 0x0D3F87FF, 0x0D7F830B, 0x0F802000, 0x0F867800,
+  0x0F8C7000, 0x0F8C8809, 0x0F900120, 0x0F996808, 0x0F99B845, 0x0F9BF015,
+  0x0F9D002A, 0x0F9E7804, 0x0F9F0010, 0x0F9FA000, 0x0F9FC046, 0x0FA20000,
+  0x0FA210BA, 0x0FA7F83E, 0x0FAA5803, 0x0FAA8017, 0x0FABD000, 0x0FACA801,
+  0x0FAD2000, 0x0FAFD854, 0x0FB40045, 0x0FB66000, 0x0FB68002, 0x0FB6A80A,
+  0x0FB75801, 0x0FB7A008, 0x0FBF0010, 0x0FC8602E, 0x0FC9E009, 0x0FCA38B8,
+  0x0FD38086
+};
+
+static bool in_table (unsigned int, const unsigned int*, size_t);
+static void skip_zero_width (const char*, size_t, size_t&);
+
+////////////////////////////////////////////////////////////////////////////////
+// The number of columns a code point occupies: 0, 1 or 2.  Control characters
+// are given one column, as they always have been.
+int utf8_char_width (unsigned int cp)
+{
+  if (cp < 0x300)
+    return 1;
+
+  if (in_table (cp, zero_width, sizeof (zero_width) / sizeof (zero_width[0])))
+    return 0;
+
+  if ((cp >= 0x20000 && cp <= 0x2FFFD) ||
+      (cp >= 0x30000 && cp <= 0x3FFFD) ||
+      in_table (cp, double_width, sizeof (double_width) / sizeof (double_width[0])))
+    return 2;
+
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Decodes the code point at text[i], and advances i past it.  Malformed or
+// truncated sequences decode as U+FFFD, one byte at a time.
+unsigned int utf8_decode (const char* text, size_t len, size_t& i)
+{
+  const unsigned char* s = (const unsigned char*) text;
+  unsigned int lead = s[i];
+
+  size_t extra;
+  unsigned int cp;
+       if (lead < 0x80)           { ++i; return lead; }
+  else if ((lead & 0xE0) == 0xC0) { extra = 1; cp = lead & 0x1F; }
+  else if ((lead & 0xF0) == 0xE0) { extra = 2; cp = lead & 0x0F; }
+  else if ((lead & 0xF8) == 0xF0) { extra = 3; cp = lead & 0x07; }
+  else                            { ++i; return 0xFFFD; }
+
+  if (i + extra >= len)
+  {
+    ++i;
+    return 0xFFFD;
+  }
+
+  for (size_t n = 1; n <= extra; ++n)
+  {
+    if ((s[i + n] & 0xC0) != 0x80)
+    {
+      ++i;
+      return 0xFFFD;
+    }
+
+    cp = (cp << 6) | (s[i + n] & 0x3F);
+  }
+
+  i += extra + 1;
+  return cp;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The number of columns occupied by text.  ASCII runs are measured in blocks.
+int utf8_width (const char* text, size_t len)
+{
+  int width = 0;
+  size_t i = 0;
+  while (i < len)
+  {
+    if ((unsigned char) text[i] < 0x80)
+    {
+      size_t run = simd_ascii_prefix (text + i, len - i);
+      width += run;
+      i += run;
+    }
+    else
+      width += utf8_char_width (utf8_decode (text, len, i));
+  }
+
+  return width;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Locates the bytes of text that are visible in the columns [skip, skip +
+// columns).  The result is text[start, end), preceded by lpad and followed by
+// rpad blank columns.  Padding stands in for a double-width character that
+// straddles either edge.  Zero-width characters stay with the character they
+// follow.
+void utf8_clip (
+  const char* text,
+  size_t len,
+  int skip,
+  int columns,
+  size_t& start,
+  size_t& end,
+  int& lpad,
+  int& rpad)
+{
+  size_t i = 0;
+  int col = 0;
+
+  // Skip the leading columns.  Only as much text as could be visible is
+  // scanned for ASCII.
+  size_t ascii = simd_ascii_prefix (text, min (len, (size_t) skip));
+  if ((size_t) skip == ascii)
+  {
+    i = skip;
+    col = skip;
+    if (skip > 0)
+      skip_zero_width (text, len, i);
+  }
+  else
+  {
+    i = ascii;
+    col = ascii;
+    while (i < len)
+    {
+      size_t next = i;
+      int w = utf8_char_width (utf8_decode (text, len, next));
+      if (col + w > skip)
+        break;
+
+      col += w;
+      i = next;
+    }
+
+    // A double-width character is cut in half, so skip it, and anything
+    // combined with it.
+    if (col < skip && i < len)
+    {
+      utf8_decode (text, len, i);
+      col += 2;
+      skip_zero_width (text, len, i);
+    }
+  }
+
+  start = i;
+  lpad = min (max (col - skip, 0), columns);
+  int used = lpad;
+
+  // Take the visible columns.
+  size_t take = simd_ascii_prefix (text + i, min (len - i, (size_t) (columns - used)));
+  i += take;
+  used += take;
+
+  rpad = 0;
+  while (i < len)
+  {
+    size_t next = i;
+    int w = utf8_char_width (utf8_decode (text, len, next));
+    if (used + w > columns)
+    {
+      rpad = columns - used;
+      break;
+    }
+
+    used += w;
+    i = next;
+  }
+
+  end = i;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static bool in_table (unsigned int cp, const unsigned int* table, size_t size)
+{
+  if (cp < (table[0] >> 11))
+    return false;
+
+  size_t low = 0;
+  size_t high = size;
+  while (low < high)
+  {
+    size_t mid = (low + high) / 2;
+    unsigned int first = table[mid] >> 11;
+    if (cp < first)
+      high = mid;
+    else if (cp > first + (table[mid] & 0x7FF))
+      low = mid + 1;
+    else
+      return true;
+  }
+
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Advances i past any zero-width characters.
+static void skip_zero_width (const char* text, size_t len, size_t& i)
+{
+  while (i < len)
+  {
+    size_t next = i;
+    if (utf8_char_width (utf8_decode (text, len, next)) != 0)
+      break;
+
+    i = next;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,188 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <atomic>
+#include <thread>
+#include <errno.h>
+#include <poll.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <writer.h>
+
+// A frame of output.  Frames are passed between the threads on two lock-free
+// stacks: queued frames to the writer, and written frames back for reuse.
+// Usually two frames are in circulation, one being built and one written.
+struct frame
+{
+  std::string bytes;
+  frame* next;
+};
+
+static std::atomic <frame*> queued (NULL);  // Newest first
+static std::atomic <frame*> spare (NULL);
+static std::atomic <bool> stopping (false);
+static sem_t wake;
+static std::thread writer;
+static bool running = false;
+static int target = -1;                     // File descriptor written to
+
+static void push (std::atomic <frame*>&, frame*);
+static void work ();
+static void write_all (const std::string&);
+
+////////////////////////////////////////////////////////////////////////////////
+// Starts the writer thread, writing to fd.  Returns false if it could not be
+// started.
+bool writer_start (int fd)
+{
+  if (running)
+    return true;
+
+  if (sem_init (&wake, 0, 0) == -1)
+    return false;
+
+  target = fd;
+  stopping = false;
+  writer = std::thread (work);
+  running = true;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Stops the writer thread, once everything sent has been written.
+void writer_stop ()
+{
+  if (! running)
+    return;
+
+  stopping = true;
+  sem_post (&wake);
+  writer.join ();
+  sem_destroy (&wake);
+  running = false;
+
+  for (frame* f = spare.exchange (NULL); f; )
+  {
+    frame* next = f->next;
+    delete f;
+    f = next;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool writer_running ()
+{
+  return running;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Queues bytes for the writer, and returns immediately.  The bytes are swapped
+// with the buffer of a written frame, so the caller builds the next frame in
+// that buffer without copying.  Frames not yet written are never dropped,
+// because they are differences.  Only this thread takes from the spare stack,
+// so popping it is free of the ABA problem.
+void writer_send (std::string& bytes)
+{
+  frame* f = spare.load ();
+  while (f && ! spare.compare_exchange_weak (f, f->next))
+    ;
+
+  if (! f)
+    f = new frame;
+
+  f->bytes.swap (bytes);
+  push (queued, f);
+  sem_post (&wake);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static void push (std::atomic <frame*>& stack, frame* f)
+{
+  f->next = stack.load ();
+  while (! stack.compare_exchange_weak (f->next, f))
+    ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Takes all queued frames at once, writes them oldest first, and returns them
+// for reuse.  When stopping, the queue is drained first.
+static void work ()
+{
+  while (true)
+  {
+    while (sem_wait (&wake) == -1 && errno == EINTR)
+      ;
+
+    frame* newest = queued.exchange (NULL);
+    frame* oldest = NULL;
+    while (newest)
+    {
+      frame* next = newest->next;
+      newest->next = oldest;
+      oldest = newest;
+      newest = next;
+    }
+
+    while (oldest)
+    {
+      frame* next = oldest->next;
+      write_all (oldest->bytes);
+      oldest->bytes.clear ();
+      push (spare, oldest);
+      oldest = next;
+    }
+
+    if (stopping && ! queued.load ())
+      return;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Writes all the bytes, unless the write fails.  A non-blocking target that is
+// full is waited on, rather than retried in a loop.
+static void write_all (const std::string& bytes)
+{
+  size_t done = 0;
+  while (done < bytes.size ())
+  {
+    ssize_t written = write (target, bytes.data () + done, bytes.size () - done);
+    if (written > 0)
+      done += written;
+    else if (written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      struct pollfd writable = {target, POLLOUT, 0};
+      if (poll (&writable, 1, -1) == -1 && errno != EINTR)
+        return;
+    }
+    else if (written == 0 || errno != EINTR)
+      return;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,192 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <vitapi.h>
+#include <test.h>
+
+#define WIDTH  80
+#define HEIGHT 24
+#define WARMUP 20
+#define FRAMES 100
+
+// Every allocation made while counting is on is counted.
+static bool counting = false;
+static size_t allocations = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+void* operator new (size_t size)
+{
+  if (counting)
+    ++allocations;
+
+  void* p = malloc (size ? size : 1);
+  if (! p)
+    throw std::bad_alloc ();
+
+  return p;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void operator delete (void* p) noexcept
+{
+  free (p);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void operator delete (void* p, size_t) noexcept
+{
+  free (p);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draws and refreshes a warm-up run of frames, then counts the allocations
+// made by the frames that follow.
+static size_t measure (void (*draw) (int))
+{
+  int f = 0;
+  for (; f < WARMUP; ++f)
+  {
+    draw (f);
+    vapi_refresh ();
+  }
+
+  allocations = 0;
+  counting = true;
+  for (; f < WARMUP + FRAMES; ++f)
+  {
+    draw (f);
+    vapi_refresh ();
+  }
+
+  counting = false;
+  return allocations;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// A status line with a changing counter, a box and a rule.
+static void text (int f)
+{
+  static color blue = color_def ("white on blue");
+  static color red = color_def ("bold red");
+  static wcolor orange = wcolor_def ("#ff8000 on #202040");
+  char line[64];
+  snprintf (line, sizeof (line), "Frame %d of the \xe6\x97\xa5\xe6\x9c\xac test", f);
+  vapi_pos_color_text (1, 1, blue, line);
+  vapi_rectangle (5, 4, 30, 6, blue);
+  vapi_hline (1, 12, WIDTH, red, "\xe2\x94\x80");
+  vapi_moveto (10, 14);
+  vapi_text ("plain text at the cursor");
+  vapi_pos_wcolor_text (2, 16, orange, line);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Nothing changes.
+static void unchanged (int)
+{
+  static color green = color_def ("green");
+  vapi_pos_color_text (1, 1, green, "The same text every frame");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Every row changes.
+static void full (int f)
+{
+  static color colors[] = {color_def ("red"), color_def ("on blue"), color_def ("yellow")};
+  char line[WIDTH + 1];
+  for (int y = 1; y <= HEIGHT; ++y)
+  {
+    for (int x = 0; x < WIDTH; ++x)
+      line[x] = 'a' + (x + y + f) % 26;
+
+    line[WIDTH] = '\0';
+    vapi_pos_color_text (1, y, colors[(y + f) % 3], line);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The screen scrolls up a row, and a new row is drawn at the bottom.
+static void scrolled (int f)
+{
+  char line[64];
+  snprintf (line, sizeof (line), "Log line %d", f);
+  vapi_scroll (1, HEIGHT, 1);
+  vapi_pos_text (1, HEIGHT, line);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static int layer = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+// A status line drawn into a layer that moves over the screen.
+static void layered (int f)
+{
+  char line[32];
+  snprintf (line, sizeof (line), "Layer %d", f);
+  vapi_layer_select (layer);
+  vapi_pos_text (1, 1, line);
+  vapi_layer_select (0);
+  vapi_layer_move (layer, 1 + f % 10, 1 + f % 5);
+  vapi_pos_text (1, HEIGHT, line);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main (int argc, char** argv)
+{
+  UnitTest t (9);
+
+  setenv ("TERM", "xterm", 1);
+  unsetenv ("COLORTERM");
+  t.is (vapi_initialize (), 0, "vapi_initialize xterm");
+  t.is (vapi_headless (WIDTH, HEIGHT), 0, "vapi_headless");
+
+  // Direct drawing.
+  t.is ((int) measure (text), 0, "direct drawing allocates nothing");
+
+  // Buffered refresh.
+  vapi_buffered (1);
+  t.is ((int) measure (text), 0, "buffered drawing allocates nothing");
+  t.is ((int) measure (unchanged), 0, "unchanged refresh allocates nothing");
+  t.is ((int) measure (full), 0, "full refresh allocates nothing");
+  t.is ((int) measure (scrolled), 0, "scrolled refresh allocates nothing");
+
+  vapi_threads (4);
+  t.is ((int) measure (full), 0, "threaded refresh allocates nothing");
+  vapi_threads (0);
+
+  layer = vapi_layer_create (1, 1, 20, 3, 1);
+  t.is ((int) measure (layered), 0, "layered refresh allocates nothing");
+
+  vapi_buffered (0);
+  vapi_deinitialize ();
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -27,6 +27,7 @@
 ////////////////////////////////////////////////////////////////////////////////
 #include <iostream>
 #include <stdio.h>
+#include <stdlib.h>
 #include <test.h>
 #include <string.h>
 #include <vitapi.h>
@@ -34,7 +35,7 @@
 ////////////////////////////////////////////////////////////////////////////////
 int main (int argc, char** argv)
 {
-  UnitTest t (1048);
+  UnitTest t (1085);
 
   // Non-color.
   t.is (color_def ("none"),         0, "none -> 0");
@@ -211,6 +212,19 @@ int main (int argc, char** argv)
     t.is (value, codes, description);
   }
 
+  // Colorizing directly into a separate buffer.
+  char out [64];
+  t.is (color_colorize_text (out, 64, color_def ("red"), "foobar", 3), 12, "color_colorize_text red foo -> 12 bytes");
+  t.is (out, "\033[31mfoo\033[0m",            "color_colorize_text red foo -> ^[[31mfoo^[[0m");
+  t.is (color_colorize_text (out, 64, color_def ("on color7"), "bar", 3), 16, "color_colorize_text on color7 bar -> 16 bytes");
+  t.is (out, "\033[48;5;7mbar\033[0m",        "color_colorize_text on color7 bar -> ^[[48;5;7mbar^[[0m");
+  t.is (color_colorize_text (out, 4, 0, "foo", 3), 3, "color_colorize_text none foo -> 3 bytes");
+  t.is (color_colorize_text (out, 12, color_def ("red"), "foo", 3), -1, "color_colorize_text insufficient buffer -> -1");
+
+  size_t len;
+  t.is (color_prologue (color_def ("bold underline red"), &len), "\033[1;4;31m", "color_prologue bold underline red -> ^[[1;4;31m");
+  t.is (color_epilogue (0, &len), "", "color_epilogue none -> ''");
+
   // Test color_def ("123456789") which, in combination with color_name can
   // be tested via round-trip conversion.
   strcpy (description, "bold underline red on bright yellow");
@@ -253,6 +267,122 @@ int main (int argc, char** argv)
   t.is (color_downgrade (black, 16), color_def ("on black"),        "on rgb011 -> @16 on black");
   t.is (color_downgrade (black, 8),  color_def ("on black"),        "on rgb011 -> @8 on black");
 
+  // Array downgrades match individual downgrades.
+  color all [512];
+  color down [512];
+  for (int i = 0; i < 256; ++i)
+  {
+    sprintf (name, "color%d on color%d", i, 255 - i);
+    all[i] = color_def (name);
+    sprintf (name, "bold color%d", i % 8);
+    all[i + 256] = i % 2 ? color_def (name) : -1;
+  }
+
+  bool same16 = color_downgrade_array (all, down, 512, 16) == 0;
+  for (int i = 0; i < 512; ++i)
+    if (down[i] != (all[i] == -1 ? -1 : color_downgrade (all[i], 16)))
+      same16 = false;
+  t.ok (same16, "color_downgrade_array @16 matches color_downgrade");
+
+  bool same8 = color_downgrade_array (all, down, 512, 8) == 0;
+  for (int i = 0; i < 512; ++i)
+    if (down[i] != (all[i] == -1 ? -1 : color_downgrade (all[i], 8)))
+      same8 = false;
+  t.ok (same8, "color_downgrade_array @8 matches color_downgrade");
+
+  t.is (color_downgrade_array (all, all, 512, 4), -1, "Cannot downgrade array to 4 colors");
+  t.is (color_downgrade_array (all, all, 512, 16), 0, "color_downgrade_array in place");
+
+  // Perceptual downgrades keep grays gray.
+  t.is (color_downgrade (color_def ("gray12"), 16 | _COLOR_QUANTIZE_PERCEPTUAL), color_def ("bold black"), "gray12 -> @16 perceptual bold black");
+  t.is (color_downgrade (color_def ("rgb222"), 16 | _COLOR_QUANTIZE_PERCEPTUAL), color_def ("bold black"), "rgb222 -> @16 perceptual bold black");
+  t.is (color_downgrade (color_def ("gray12"), 8 | _COLOR_QUANTIZE_PERCEPTUAL),  color_def ("white"),      "gray12 -> @8 perceptual white");
+  t.is (color_downgrade (color_def ("on rgb500"), 16 | _COLOR_QUANTIZE_PERCEPTUAL), color_def ("on bright red"), "on rgb500 -> @16 perceptual on bright red");
+  t.is (color_downgrade (color_def ("gray12"), 4 | _COLOR_QUANTIZE_PERCEPTUAL), -1, "Cannot downgrade perceptual to 4 colors");
+  t.is (color_downgrade (color_def ("gray12"), _COLOR_QUANTIZE_256 | _COLOR_QUANTIZE_PERCEPTUAL), -1, "Cannot downgrade perceptual to 256 colors");
+
+  bool same_perceptual = color_downgrade_array (all, down, 512, 16 | _COLOR_QUANTIZE_PERCEPTUAL) == 0;
+  for (int i = 0; i < 512; ++i)
+    if (down[i] != (all[i] == -1 ? -1 : color_downgrade (all[i], 16 | _COLOR_QUANTIZE_PERCEPTUAL)))
+      same_perceptual = false;
+  t.ok (same_perceptual, "color_downgrade_array @16 perceptual matches color_downgrade");
+
+  // 24-bit colors, quantized by color_def.
+  t.is (color_def ("#ff0000"), color_def ("color196"),    "#ff0000 -> color196");
+  t.is (color_def ("on #808080"), color_def ("on gray12"), "on #808080 -> on gray12");
+  t.is (color_def ("#ff00zz"), -1,                        "#ff00zz -> -1");
+
+  // 24-bit colors, unquantized by wcolor_def.
+  wcolor_set_depth (_COLOR_QUANTIZE_NONE);
+  t.is (wcolor_colorize_text (out, 64, wcolor_def ("#ff8000"), "foo", 3), 24, "#ff8000 -> 24 bytes");
+  t.is (out, "\033[38;2;255;128;0mfoo\033[0m", "#ff8000 -> ^[[38;2;255;128;0m");
+  strcpy (value, "foo"); wcolor_colorize (value, 256, wcolor_def ("red on #202020"));
+  t.is (value, "\033[38;5;1m\033[48;2;32;32;32mfoo\033[0m", "red on #202020 -> ^[[38;5;1m^[[48;2;32;32;32m");
+
+  c = color_def ("underline red on white");
+  t.is (wcolor_to_color (wcolor_from_color (c)), c, "wcolor round-trip underline red on white");
+  t.is (wcolor_to_color (wcolor_def ("#ff0000 on #000000")), color_def ("color196 on color16"), "#ff0000 on #000000 -> color196 on color16");
+
+  // Automatic downgrades.
+  wcolor_set_depth (_COLOR_QUANTIZE_256);
+  strcpy (value, "foo"); wcolor_colorize (value, 256, wcolor_def ("#ff0000"));
+  t.is (value, "\033[38;5;196mfoo\033[0m", "#ff0000 @256 -> ^[[38;5;196m");
+  wcolor_set_depth (_COLOR_QUANTIZE_16);
+  strcpy (value, "foo"); wcolor_colorize (value, 256, wcolor_def ("#ff0000"));
+  t.is (value, "\033[1;31mfoo\033[0m", "#ff0000 @16 -> ^[[1;31m");
+  wcolor_set_depth (_COLOR_QUANTIZE_NONE);
+
+  // Perceptual applies only to 8 or 16 colors.
+  t.is (wcolor_set_depth (_COLOR_QUANTIZE_PERCEPTUAL), -1, "Cannot set depth to perceptual alone");
+  t.is (wcolor_set_depth (_COLOR_QUANTIZE_256 | _COLOR_QUANTIZE_PERCEPTUAL), -1, "Cannot set depth to perceptual 256 colors");
+  t.is (wcolor_set_depth (_COLOR_QUANTIZE_16 | _COLOR_QUANTIZE_PERCEPTUAL), _COLOR_QUANTIZE_NONE, "Rejected depths are not set");
+  wcolor_set_depth (_COLOR_QUANTIZE_NONE);
+
+  // Array conversions must match the single-value functions exactly.
+  static int rgb[65536 + 3];
+  static unsigned char index[65536 + 3];
+  bool same_rgb = true;
+  for (int r = 0; r < 256; ++r)
+  {
+    for (int i = 0; i < 65536; ++i)
+      rgb[i] = (r << 16) | i;
+
+    if (color_rgb_index_array (rgb, index, 65536) != 0)
+      same_rgb = false;
+
+    for (int i = 0; i < 65536; ++i)
+      if (index[i] != color_rgb_index (r, i >> 8, i & 0xFF))
+        same_rgb = false;
+  }
+  t.ok (same_rgb, "color_rgb_index_array matches color_rgb_index for all rgb");
+
+  rgb[0] = 0x7F000000 | 0xFF8000; rgb[1] = 0x808080; rgb[2] = 0x000000;
+  color_rgb_index_array (rgb, index, 3);
+  t.ok (index[0] == 208 && index[1] == 244 && index[2] == 16, "color_rgb_index_array ignores high bits, handles a short tail");
+
+  srand (1);
+  static color ones[1003], twos[1003], result[1003];
+  for (int i = 0; i < 1003; ++i)
+  {
+    ones[i] = i % 17 == 0 ? -1 : (rand () & 0x7FFFFF);
+    twos[i] = i % 13 == 0 ? -1 : (rand () & 0x7FFFFF);
+  }
+  ones[7] = twos[7] = 0;
+
+  bool same_upgrade = color_upgrade_array (ones, result, 1003) == 0;
+  for (int i = 0; i < 1003; ++i)
+    if (result[i] != (ones[i] == -1 ? -1 : color_upgrade (ones[i])))
+      same_upgrade = false;
+  t.ok (same_upgrade, "color_upgrade_array matches color_upgrade");
+
+  bool same_blend = color_blend_array (ones, twos, result, 1003) == 0;
+  for (int i = 0; i < 1003; ++i)
+    if (result[i] != (ones[i] == -1 && twos[i] == -1 ? -1 : color_blend (ones[i], twos[i])))
+      same_blend = false;
+  t.ok (same_blend, "color_blend_array matches color_blend");
+
+  t.is (color_blend_array (ones, NULL, result, 1), -1, "color_blend_array rejects a null array");
+
   return 0;
 }
 
@@ -0,0 +1,170 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vitapi.h>
+#include <histogram.h>
+#include <test.h>
+
+static int keyboard[2];          // Pipe that stands in for the terminal
+
+////////////////////////////////////////////////////////////////////////////////
+// Reads stdin from the keyboard pipe, and initializes iapi without letting it
+// write to stdout, which holds the test results.
+static int initialize ()
+{
+  if (pipe (keyboard) == -1)
+    return -1;
+
+  dup2 (keyboard[0], 0);
+
+  std::cout << std::flush;
+  int out = dup (1);
+  int null = open ("/dev/null", O_WRONLY);
+  dup2 (null, 1);
+  int result = iapi_initialize ();
+  std::cout << std::flush;
+  dup2 (out, 1);
+  close (out);
+  close (null);
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static void type (const char* keys)
+{
+  if (write (keyboard[1], keys, strlen (keys)) == -1)
+    exit (1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Reads keys until the replay ends, and returns them.
+static std::vector <int> replay ()
+{
+  std::vector <int> keys;
+  int key;
+  while ((key = iapi_getch ()) != -1)
+    keys.push_back (key);
+
+  return keys;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static long long microseconds ()
+{
+  return std::chrono::duration_cast <std::chrono::microseconds> (
+           std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main (int argc, char** argv)
+{
+  setenv ("TERM", "xterm", 1);
+  int initialized = initialize ();
+
+  UnitTest t (20);
+  t.is (initialized, 0, "iapi_initialize xterm");
+
+  // Histogram percentiles are within a bucket of the true value.
+  histogram h;
+  histogram_clear (h);
+  t.ok (histogram_percentile (h, 0.5) == 0, "empty histogram -> 0");
+  for (int i = 1; i <= 10000; ++i)
+    histogram_add (h, i);
+
+  long long p50 = histogram_percentile (h, 0.5);
+  long long p99 = histogram_percentile (h, 0.99);
+  t.ok (p50 >= 5000 && p50 <= 5000 + 5000 / 64, "p50 of 1..10000 -> 5000, within 1/64");
+  t.ok (p99 >= 9900 && p99 <= 10000, "p99 of 1..10000 -> 9900, within 1/64, at most the max");
+  t.ok (histogram_percentile (h, 1.0) == 10000, "p100 -> max");
+
+  // Latency includes the sequence delay, and queued keys wait for the call.
+  iapi_set_delay (20000);
+  iapi_latency_reset ();
+  type ("a");
+  t.is (iapi_getch (), (int) 'a', "a -> a");
+  type ("\033OAbc");
+  t.is (iapi_getch (), IAPI_KEY_UP, "<Esc>OA -> IAPI_KEY_UP");
+  t.is (iapi_getch (), (int) 'b', "queued b -> b");
+  t.is (iapi_getch (), (int) 'c', "queued c -> c");
+
+  struct iapi_latency latency;
+  iapi_latency_get (&latency);
+  t.is (latency.events, (size_t) 4, "4 events recorded");
+  t.ok (latency.decode_p50 >= 20000 &&
+        latency.decode_p50 <= latency.decode_p99 &&
+        latency.decode_p99 <= latency.decode_max, "decode latency includes the 20ms delay");
+  t.ok (latency.wait_p50 == 0 && latency.wait_max >= 20000, "a queued key waits while the key before it is decoded");
+
+  // Recorded input replays through the decoder, from a file or memory.
+  char path[] = "/tmp/vitapi-keys-XXXXXX";
+  close (mkstemp (path));
+  iapi_set_delay (1000);
+  t.is (iapi_record_start (path), 0, "iapi_record_start");
+
+  std::vector <int> typed;
+  type ("a");
+  typed.push_back (iapi_getch ());
+  usleep (50000);
+  type ("\033OAbc\033[15~");
+  for (int i = 0; i < 4; ++i)
+    typed.push_back (iapi_getch ());
+
+  t.is (iapi_record_stop (), 0, "iapi_record_stop");
+  int expected[] = {'a', IAPI_KEY_UP, 'b', 'c', IAPI_KEY_F5};
+  t.ok (typed == std::vector <int> (expected, expected + 5), "live keys a, Up, b, c, F5");
+
+  t.is (iapi_replay_file (path, 0), 0, "iapi_replay_file");
+  long long start = microseconds ();
+  t.ok (replay () == typed, "fast replay from a file decodes the same keys");
+  long long fast = microseconds () - start;
+
+  FILE* file = fopen (path, "rb");
+  char buffer[256];
+  size_t bytes = fread (buffer, 1, sizeof (buffer), file);
+  fclose (file);
+  t.is (iapi_replay_buffer (buffer, bytes, 1), 0, "iapi_replay_buffer");
+  start = microseconds ();
+  t.ok (replay () == typed, "timed replay from memory decodes the same keys");
+  long long timed = microseconds () - start;
+  t.ok (timed >= 45000 && fast < 20000, "timed replay keeps the pause, fast replay does not");
+
+  iapi_replay_stop ();
+  unlink (path);
+  close (keyboard[1]);
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -25,13 +25,14 @@
 // http://www.opensource.org/licenses/mit-license.php
 //
 ////////////////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
 #include <vitapi.h>
 #include <test.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 int main (int argc, char** argv)
 {
-  UnitTest t (7);
+  UnitTest t (13);
 
   t.is (tapi_initialize ("xterm-256color"),  0, "tapi_initialize xterm-256color good");
   t.is (tapi_initialize ("foo"),            -1, "tapi_initialize foo bad");
@@ -59,6 +60,25 @@ int main (int argc, char** argv)
         "\033\033\033\033\033\033\033\033",
         "_E__E__E__E__E__E__E__E_ -> \\033\\033\\033\\033\\033\\033\\033\\033");
 
+  // Keys are whole words.
+  tapi_add ("foo", "xb:1 ab:2 b:3");
+  t.is (tapi_get ("b", value, 64), "3", "b is not found within xb or ab");
+  t.is (tapi_get ("x", value, 64), "", "x is not a prefix match for xb");
+
+  // Count substitution.
+  tapi_initialize ("xterm-256color");
+  t.is (tapi_get_n ("ec", value, 64, 12), "\033[12X", "ec 12 -> ^[[12X");
+  t.is (tapi_get_n ("rp", value, 64, 3), "\033[3b", "rp 3 -> ^[[3b");
+
+  // 24-bit color support comes from $COLORTERM.
+  unsetenv ("COLORTERM");
+  tapi_initialize ("xterm-256color");
+  t.is (tapi_get ("Tc", value, 64), "", "Tc without COLORTERM -> ''");
+
+  setenv ("COLORTERM", "truecolor", 1);
+  tapi_initialize ("xterm-256color");
+  t.is (tapi_get ("Tc", value, 64), "1", "Tc with COLORTERM=truecolor -> 1");
+
   return 0;
 }
 
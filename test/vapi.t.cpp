@@ -0,0 +1,404 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <functional>
+#include <vitapi.h>
+#include <test.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// The number of bytes needed to move to [x,y].
+static int move_size (int x, int y)
+{
+  char mv[64];
+  return strlen (tapi_get_xy ("Mv", mv, 64, x, y));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Captures what an action writes to stdout.
+static std::string capture (const std::function <void ()>& action)
+{
+  std::cout << std::flush;
+  fflush (stdout);
+
+  char name[] = "/tmp/vapi.t.XXXXXX";
+  int fd = mkstemp (name);
+  int saved = dup (1);
+  dup2 (fd, 1);
+  action ();
+  fflush (stdout);
+  dup2 (saved, 1);
+  close (saved);
+
+  std::string captured;
+  char buffer[4096];
+  ssize_t bytes;
+  lseek (fd, 0, SEEK_SET);
+  while ((bytes = read (fd, buffer, sizeof (buffer))) > 0)
+    captured.append (buffer, bytes);
+
+  close (fd);
+  unlink (name);
+  return captured;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Captures what vapi_refresh writes to stdout.
+static std::string refresh_output ()
+{
+  return capture (vapi_refresh);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draws rows 1 to 20 as lines first to first + 19 of a list.
+static void draw_list (int first)
+{
+  vapi_clear ();
+  for (int y = 1; y <= 20; ++y)
+  {
+    char line[64];
+    snprintf (line, 64, "Item %d of a long and colorful list", first + y - 1);
+    vapi_pos_color_text (1, y, color_def ("bold yellow on blue"), line);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draws a title and a rule below it, offset by [dx,dy].
+static void draw_chrome (int dx, int dy)
+{
+  color c = color_def ("bold white on blue");
+  vapi_pos_color_text (2 + dx, 1 + dy, c, "Title \xe6\x97\xa5\xe6\x9c\xac");
+  vapi_hline (1 + dx, 2 + dy, 30, c, "\xe2\x94\x80");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main (int argc, char** argv)
+{
+  UnitTest t (69);
+
+  // Display widths.
+  t.is (vapi_text_width ("abc"),                 3, "width 'abc' -> 3");
+  t.is (vapi_text_width (""),                    0, "width '' -> 0");
+  t.is (vapi_text_width ("\xe6\x97\xa5\xe6\x9c\xac"), 4, "width CJK x2 -> 4");
+  t.is (vapi_text_width ("e\xcc\x81"),           1, "width e + combining acute -> 1");
+  t.is (vapi_text_width ("\xf0\x9f\x98\x80"),    2, "width emoji -> 2");
+  t.is (vapi_text_width ("\xff\xe6\x97"),        3, "width malformed bytes -> 1 each");
+  t.is (vapi_text_width ("0123456789012345678901234567890123456789x\xc3\xa9"), 42, "width long ASCII run + e-acute -> 42");
+
+  // Cropping, measured in bytes of output.
+  setenv ("TERM", "xterm", 1);
+  t.is (vapi_initialize (), 0, "vapi_initialize xterm");
+  vapi_discard ();
+
+  int w = vapi_width ();
+  vapi_pos_text (w - 2, 1, "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e");
+  t.is (vapi_discard (), move_size (w - 2, 1) + 3 + 1, "CJK cut at the right edge is padded");
+
+  vapi_pos_text (0, 1, "\xe6\x97\xa5\xe6\x9c\xac");
+  t.is (vapi_discard (), move_size (1, 1) + 1 + 3, "CJK cut at the left edge is padded");
+
+  vapi_pos_text (-1, 2, "abc\xcc\x81" "d");
+  t.is (vapi_discard (), move_size (1, 2) + 3 + 1, "combining character stays with its base");
+
+  vapi_pos_text (-5, 1, "abc");
+  t.is (vapi_discard (), 0, "off-screen text is not drawn");
+
+  size_t prologue;
+  size_t epilogue;
+  color c = color_def ("red");
+  color_prologue (c, &prologue);
+  color_epilogue (c, &epilogue);
+  vapi_pos_color_text (w - 1, 3, c, "abcdef");
+  t.is (vapi_discard (), (int) (move_size (w - 1, 3) + prologue + 2 + epilogue), "colored text cropped by column");
+
+  vapi_pos_color_text (w - 1, 3, c, "\xc3\xa9\xc3\xa9\xc3\xa9");
+  t.is (vapi_discard (), (int) (move_size (w - 1, 3) + prologue + 4 + epilogue), "multi-byte text is not split");
+
+  // Length-aware drawing.
+  vapi_pos_text_len (1, 4, "abcdef", 3);
+  t.is (vapi_discard (), move_size (1, 4) + 3, "vapi_pos_text_len draws only len bytes");
+
+  vapi_pos_color_text_len (w - 1, 4, c, "\xe6\x97\xa5\xe6\x9c\xac", 3);
+  t.is (vapi_discard (), (int) (move_size (w - 1, 4) + prologue + 3 + epilogue), "vapi_pos_color_text_len crops within len");
+
+  std::string big (10000, 'x');
+  vapi_color_text (c, big.c_str ());
+  t.is (vapi_discard (), (int) (prologue + 10000 + epilogue), "vapi_color_text has no size limit");
+
+  vapi_pos_text (1, 5, big);
+  t.is (vapi_discard (), move_size (1, 5) + w, "vapi_pos_text accepts std::string");
+
+  // Fills use the shortest encoding.  Colors are set once per rectangle.
+  color blue = color_def ("on blue");
+  size_t blue_prologue;
+  size_t blue_epilogue;
+  color_prologue (blue, &blue_prologue);
+  color_epilogue (blue, &blue_epilogue);
+
+  vapi_rectangle (1, 1, 20, 2, blue);
+  t.is (vapi_discard (), (int) (blue_prologue + move_size (1, 1) + move_size (1, 2) + 2 * strlen ("\033[20X") + blue_epilogue),
+        "vapi_rectangle erases with ec");
+
+  vapi_rectangle (w - 9, 1, 10, 1, blue);
+  t.is (vapi_discard (), (int) (blue_prologue + move_size (w - 9, 1) + strlen ("\033[K") + blue_epilogue),
+        "vapi_rectangle at the right edge erases with ce");
+
+  color under = color_def ("underline on blue");
+  size_t under_prologue;
+  size_t under_epilogue;
+  color_prologue (under, &under_prologue);
+  color_epilogue (under, &under_epilogue);
+  vapi_rectangle (1, 1, 20, 1, under);
+  t.is (vapi_discard (), (int) (under_prologue + move_size (1, 1) + strlen (" \033[19b") + under_epilogue),
+        "vapi_rectangle repeats underlined blanks with rp");
+
+  vapi_rectangle (-4, 1, 6, 1, blue);
+  t.is (vapi_discard (), (int) (blue_prologue + move_size (1, 1) + 1 + blue_epilogue),
+        "vapi_rectangle crops its width at the left edge");
+
+  vapi_hline (1, 1, 20, c, "\xe2\x94\x80");
+  t.is (vapi_discard (), (int) (move_size (1, 1) + prologue + 3 + strlen ("\033[19b") + epilogue),
+        "vapi_hline repeats the character with rp");
+
+  vapi_hline (1, 1, 20, c, "\xe6\x97\xa5");
+  t.is (vapi_discard (), 0, "vapi_hline rejects a double-width character");
+
+  // Scrolling sets a region, scrolls, and restores the region.
+  char cs[64];
+  int h = vapi_height () - 1;   // xterm has a status line
+  vapi_scroll (2, 10, 1);
+  t.is (vapi_discard (), (int) (strlen (tapi_get_xy ("cs", cs, 64, 2, 10)) + strlen ("\033[1S") + strlen (tapi_get_xy ("cs", cs, 64, 1, h))),
+        "vapi_scroll up 1 uses SF");
+
+  vapi_scroll (2, 10, -20);
+  t.is (vapi_discard (), (int) (strlen (tapi_get_xy ("cs", cs, 64, 2, 10)) + strlen ("\033[9T") + strlen (tapi_get_xy ("cs", cs, 64, 1, h))),
+        "vapi_scroll down is limited to the region");
+
+  tapi_initialize ("vt100");
+  vapi_scroll (2, 10, 3);
+  t.is (vapi_discard (), (int) (strlen (tapi_get_xy ("cs", cs, 64, 2, 10)) + move_size (1, 10) + 3 + strlen (tapi_get_xy ("cs", cs, 64, 1, h))),
+        "vapi_scroll on vt100 indexes at the bottom of the region");
+
+  // Buffered drawing refreshes only the changes.
+  tapi_initialize ("xterm");
+  t.is (vapi_buffered (1), 0, "vapi_buffered was off");
+  draw_list (1);
+  std::string first = refresh_output ();
+  t.ok (first.find ("Item 20 of") != std::string::npos, "buffered first refresh draws everything");
+
+  draw_list (1);
+  t.is (refresh_output (), "", "buffered refresh of an unchanged frame writes nothing");
+
+  vapi_pos_color_text (6, 3, color_def ("bold yellow on blue"), "X");
+  std::string one = refresh_output ();
+  t.ok (one.find ("X") != std::string::npos && one.length () < 32, "buffered refresh of one cell is small");
+
+  // A scrolled list is detected, and only the new line drawn.
+  draw_list (1);
+  refresh_output ();
+  draw_list (2);
+  std::string scrolled = refresh_output ();
+  t.ok (scrolled.find (std::string (tapi_get_xy ("cs", cs, 64, 1, 20)) + "\033[1S") != std::string::npos,
+        "buffered refresh scrolls rows 1-20 up 1");
+  t.ok (scrolled.find ("Item 21 of") != std::string::npos &&
+        scrolled.find ("Item 20 of") == std::string::npos, "buffered refresh draws only the new line");
+  t.ok (scrolled.length () < first.length () / 10, "scrolled frame is a fraction of a full frame");
+
+  draw_list (1);
+  t.ok (refresh_output ().find (std::string (tapi_get_xy ("cs", cs, 64, 1, 20)) + "\033[1T") != std::string::npos,
+        "buffered refresh scrolls rows 1-20 down 1");
+
+  // Layers cover the screen, and uncover it again, one rectangle at a time.
+  draw_list (1);
+  refresh_output ();
+  int popup = vapi_layer_create (10, 5, 20, 5, 1);
+  t.ok (popup > 0, "vapi_layer_create returns an id");
+  t.is (vapi_layer_select (popup), 0, "vapi_layer_select was the screen");
+  vapi_rectangle (1, 1, 30, 10, color_def ("on red"));
+  vapi_pos_text (2, 2, "Popup");
+  t.is (vapi_layer_select (0), popup, "vapi_layer_select was the layer");
+
+  std::string shown = refresh_output ();
+  t.ok (shown.find ("Popup") != std::string::npos &&
+        shown.find ("Item") == std::string::npos, "layer is drawn over the screen");
+
+  vapi_pos_text (12, 7, "hidden");
+  t.is (refresh_output (), "", "drawing beneath a layer is not visible");
+
+  vapi_layer_destroy (popup);
+  std::string closed = refresh_output ();
+  t.ok (closed.find ("hidden") != std::string::npos &&
+        closed.find ("Popup") == std::string::npos &&
+        closed.length () < first.length () / 2, "destroying a layer redraws only its rectangle");
+  t.is (vapi_layer_select (popup), -1, "a destroyed layer cannot be selected");
+
+  // A layer edge that cuts a double-width character leaves a blank.
+  vapi_pos_text (1, 22, "\xe6\x97\xa5\xe6\x9c\xac");
+  int cover = vapi_layer_create (2, 22, 1, 1, 0);
+  t.is (refresh_output ().find ("\xe6\x97\xa5"), std::string::npos, "half-covered wide character is blanked");
+  vapi_layer_destroy (cover);
+
+  // Draw lists replay exactly what was recorded.
+  vapi_clear ();
+  refresh_output ();
+  int chrome = vapi_list_begin ();
+  t.ok (chrome > 0, "vapi_list_begin returns an id");
+  draw_chrome (0, 0);
+  vapi_list_end ();
+  t.is (refresh_output (), "", "recording a draw list draws nothing");
+
+  draw_chrome (0, 0);
+  std::string direct = refresh_output ();
+  vapi_clear ();
+  refresh_output ();
+  vapi_list_draw (chrome, 0, 0);
+  t.is (refresh_output (), direct, "replayed draw list matches direct drawing");
+
+  vapi_clear ();
+  refresh_output ();
+  draw_chrome (-3, 4);
+  direct = refresh_output ();
+  vapi_clear ();
+  refresh_output ();
+  vapi_list_draw (chrome, -3, 4);
+  t.is (refresh_output (), direct, "offset draw list matches direct drawing, cropped");
+
+  vapi_list_destroy (chrome);
+  vapi_list_draw (chrome, 0, 0);
+  t.is (refresh_output (), "", "a destroyed draw list draws nothing");
+
+  // Refreshing in parallel bands gives the same output.
+  std::string serial[2];
+  std::string parallel[2];
+  t.is (vapi_threads (1), 0, "vapi_threads was automatic");
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    vapi_buffered (0);
+    vapi_buffered (1);
+    draw_list (1);
+    draw_chrome (40, 2);
+    (pass ? parallel : serial)[0] = refresh_output ();
+    draw_list (3);
+    draw_chrome (41, 2);
+    (pass ? parallel : serial)[1] = refresh_output ();
+    vapi_threads (4);
+  }
+
+  t.is (parallel[0], serial[0], "parallel full frame matches serial");
+  t.is (parallel[1], serial[1], "parallel scrolled frame matches serial");
+  vapi_threads (0);
+
+  // The writer thread writes every frame, in order.
+  auto frames = [] ()
+  {
+    for (int i = 1; i <= 10; ++i)
+    {
+      draw_list (i);
+      vapi_refresh ();
+    }
+
+    vapi_async (0);
+  };
+
+  vapi_buffered (0);
+  vapi_buffered (1);
+  std::string written = capture (frames);
+
+  vapi_buffered (0);
+  vapi_buffered (1);
+  t.is (vapi_async (1), 0, "vapi_async was off");
+  t.is (capture (frames), written, "frames written by the writer thread match");
+
+  // The scheduler limits the frame rate, and coalesces requests.
+  t.is (vapi_frame_rate (10), 0, "vapi_frame_rate was unlimited");
+  t.is (vapi_frame_timeout (), -1, "no frame requested, no timeout");
+  draw_list (1);
+  refresh_output ();
+  usleep (100000);
+  vapi_pos_text (1, 1, "first");
+  t.ok (capture (vapi_invalidate).find ("first") != std::string::npos, "a due frame is refreshed at once");
+
+  vapi_pos_text (1, 2, "second");
+  vapi_invalidate ();
+  vapi_pos_text (1, 3, "third");
+  vapi_invalidate ();
+  int timeout = vapi_frame_timeout ();
+  t.ok (timeout > 0 && timeout <= 100, "early frame is deferred by up to 100ms");
+
+  usleep (timeout * 1000);
+  int ticked = 0;
+  std::string late = capture ([&] () { ticked = vapi_frame_tick (); });
+  t.is (ticked, 1, "vapi_frame_tick refreshes once the frame is due");
+  t.ok (late.find ("second") != std::string::npos &&
+        late.find ("third") != std::string::npos, "requests are coalesced into one frame");
+  t.is (vapi_frame_timeout (), -1, "no frame requested after the tick");
+  vapi_frame_rate (0);
+
+  // Output statistics, drawn directly and buffered.
+  vapi_buffered (0);
+  t.is (vapi_stats_enable (1), 0, "vapi_stats_enable was off");
+  vapi_stats_reset ();
+  vapi_pos_color_text (3, 2, color_def ("red"), "hello");
+  vapi_rectangle (1, 5, 4, 2, color_def ("on blue"));
+  std::string out = refresh_output ();
+
+  struct vapi_stats s;
+  vapi_stats_get (&s);
+  t.is (s.moves, (size_t) 3, "direct: 3 moves");
+  t.is (s.sgr,   (size_t) 2, "direct: 2 color changes");
+  t.is (s.cells, (size_t) 13, "direct: 13 cells");
+  t.ok (s.frames == 1 && s.flushes == 1, "direct: 1 frame, 1 flush");
+  t.ok (s.bytes == out.length () && s.peak_buffer == out.length (), "direct: bytes and peak buffer match the output");
+
+  vapi_buffered (1);
+  refresh_output ();
+  vapi_stats_reset ();
+  vapi_pos_color_text (1, 1, color_def ("red"), "ab");
+  vapi_pos_color_text (10, 1, color_def ("red"), "cd");
+  refresh_output ();
+  vapi_stats_get (&s);
+  t.ok (s.moves == 2 && s.sgr == 1 && s.cells == 4, "buffered: 2 moves, 1 color change, 4 cells");
+
+  t.is (vapi_stats_enable (0), 1, "vapi_stats_enable was on");
+  vapi_stats_reset ();
+  vapi_pos_text (1, 3, "uncounted");
+  refresh_output ();
+  vapi_stats_get (&s);
+  t.ok (s.frames == 0 && s.bytes == 0 && s.cells == 0, "nothing is counted while disabled");
+
+  vapi_buffered (0);
+  vapi_deinitialize ();
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,551 @@
+////////////////////////////////////////////////////////////////////////////////
+// VITapi - UI helper library that controls Visuals, Input and Terminals.
+//
+// Copyright 2010 - 2017, Göteborg Bit Factory.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// http://www.opensource.org/licenses/mit-license.php
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vitapi.h>
+#include <lines.h>
+#include <screen.h>
+#include <width.h>
+#include <test.h>
+
+#define WIDTH  60
+#define HEIGHT 20
+
+////////////////////////////////////////////////////////////////////////////////
+// The text and colors of the virtual terminal.
+static std::string snapshot ()
+{
+  std::string result;
+  char row[1024];
+  for (int y = 1; y <= HEIGHT; ++y)
+  {
+    result += vapi_headless_row (y, row, sizeof (row));
+    result += '\n';
+    for (int x = 1; x <= WIDTH; ++x)
+    {
+      char hex[32];
+      snprintf (hex, sizeof (hex), "%llx ", vapi_headless_color (x, y));
+      result += hex;
+    }
+
+    result += '\n';
+  }
+
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draws a frame of random text, fills and scrolls, repeatable by seed.
+static void random_frame (unsigned int& seed)
+{
+  static const char* texts[] =
+  {
+    "abc",
+    "Hello, world",
+    "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e",
+    "e\xcc\x81xe\xcc\x81",
+    "wide\xe6\x97\xa5x",
+    "\xe2\x94\x80\xe2\x94\xbc\xe2\x94\x80",
+    "      ",
+    "A longer line of text that will reach past the right edge of the screen",
+  };
+
+  static const char* colors[] =
+  {
+    "",
+    "red",
+    "bold yellow on blue",
+    "underline green",
+    "inverse cyan on black",
+    "color202 on gray4",
+    "rgb123",
+  };
+
+  static const char* fills[] =
+  {
+    "on blue",
+    "on bright red",
+    "on color22",
+    "on gray10",
+  };
+
+  int ops = 1 + rand_r (&seed) % 12;
+  for (int i = 0; i < ops; ++i)
+  {
+    int op = rand_r (&seed) % 40;
+    int x = rand_r (&seed) % (WIDTH + 6) - 3;
+    int y = rand_r (&seed) % HEIGHT + 1;
+    const char* text = texts[rand_r (&seed) % 8];
+    color c = color_def (colors[rand_r (&seed) % 7]);
+
+    if (op < 20)
+      vapi_pos_color_text (x, y, c, text);
+    else if (op < 24)
+      vapi_pos_wcolor_text (x, y, wcolor_def ("#ff8000 on #202040"), text);
+    else if (op < 30)
+      vapi_rectangle (x, y, rand_r (&seed) % 20 + 1, rand_r (&seed) % 5 + 1,
+                      color_def (fills[rand_r (&seed) % 4]));
+    else if (op < 34)
+      vapi_hline (x, y, rand_r (&seed) % 30 + 1, c, "\xe2\x94\x80");
+    else if (op < 39)
+    {
+      int bottom = y + rand_r (&seed) % (HEIGHT - y + 1);
+      vapi_scroll (y, bottom, rand_r (&seed) % 7 - 3);
+    }
+    else
+      vapi_clear ();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Draws frames directly, then buffered, and compares the screens after each.
+// Returns the number of frames that differ, and the bytes sent each way.
+static int compare (int frames, int threads, size_t& direct_bytes, size_t& buffered_bytes)
+{
+  std::vector <std::string> direct;
+  unsigned int seed = 1;
+
+  vapi_buffered (0);
+  vapi_headless (WIDTH, HEIGHT);
+  vapi_clear ();
+  for (int f = 0; f < frames; ++f)
+  {
+    random_frame (seed);
+    vapi_refresh ();
+    direct.push_back (snapshot ());
+  }
+
+  vapi_headless_counts (&direct_bytes, NULL);
+
+  int differ = 0;
+  seed = 1;
+  vapi_headless (WIDTH, HEIGHT);
+  vapi_buffered (1);
+  vapi_threads (threads);
+  for (int f = 0; f < frames; ++f)
+  {
+    random_frame (seed);
+    vapi_refresh ();
+    if (snapshot () != direct[f])
+      ++differ;
+  }
+
+  vapi_headless_counts (&buffered_bytes, NULL);
+  vapi_threads (0);
+  vapi_buffered (0);
+  return differ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Steps through a recording, and counts the frames that match the snapshots,
+// in order.  Their times are stored.
+static int step (const std::vector <std::string>& snapshots, std::vector <long long>& times)
+{
+  int matched = 0;
+  long long time;
+  times.clear ();
+  while ((time = vapi_play_next ()) != -1)
+  {
+    vapi_refresh ();
+    if (times.size () < snapshots.size () && snapshot () == snapshots[times.size ()])
+      ++matched;
+
+    times.push_back (time);
+  }
+
+  return matched;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scans random lines of mixed text, split across pieces at every kind of byte,
+// and checks the starts and widths against a byte-by-byte scan.
+static bool scan_matches (int threads)
+{
+  static const char* words[] =
+  {
+    "abc ",
+    "a longer run of plain ASCII text, to fill whole vector blocks ",
+    "\xe6\x97\xa5\xe6\x9c\xac",
+    "e\xcc\x81",
+    "\r",
+    "\n",
+    "\n",
+    "\n",
+  };
+
+  std::string text;
+  unsigned int seed = 3;
+  while (text.length () < 3 * 1024 * 1024)
+    text += words[rand_r (&seed) % 8];
+
+  std::vector <size_t> starts;
+  std::vector <int> widths;
+  line_scanner scanner;
+  line_scan (scanner, text.data (), text.length (), threads, starts, widths);
+
+  size_t start = 0;
+  size_t line = 0;
+  for (size_t i = 0; i <= text.length (); ++i)
+  {
+    if (i < text.length () && text[i] != '\n')
+      continue;
+
+    size_t end = i;
+    if (end > start && text[end - 1] == '\r')
+      --end;
+
+    if (i > start || i < text.length ())
+    {
+      if (line >= starts.size () || starts[line] != start ||
+          widths[line] != utf8_width (text.data () + start, end - start))
+        return false;
+
+      ++line;
+    }
+
+    start = i + 1;
+  }
+
+  return line == starts.size ();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The cells of a table of jobs, counted as they are fetched.  One job has a
+// state that changes.
+static int fetched = 0;
+static long long changing = 3;
+static std::string state = "queued";
+
+static const char* job_cell (long long row, int column, color* c, void*)
+{
+  static char text[32];
+  ++fetched;
+  if (column == 0)
+    snprintf (text, sizeof (text), "job %lld", row);
+  else if (column == 1)
+    snprintf (text, sizeof (text), "%lld", row * 7 % 1000);
+  else if (row == changing)
+  {
+    *c = color_def ("bold");
+    return state.c_str ();
+  }
+  else
+    return "done";
+
+  return text;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The fastest of several screen_diff calls, in nanoseconds.  With changes, the
+// front grid alternates between two frames that differ in every cell.
+static long long diff_time (grid& front, grid* frames, bool changes)
+{
+  long long best = -1;
+  int parity = 0;
+  for (int i = 0; i < 5; ++i)
+  {
+    std::string out;
+    if (changes)
+      parity ^= 1;
+
+    auto start = std::chrono::steady_clock::now ();
+    screen_diff (front, frames[parity], out);
+    long long ns = std::chrono::duration_cast <std::chrono::nanoseconds> (
+                     std::chrono::steady_clock::now () - start).count ();
+    if (best == -1 || ns < best)
+      best = ns;
+  }
+
+  return best;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Does diffing an unchanged blank screen cost less than a diff of every cell?
+static bool unchanged_is_cheap ()
+{
+  grid frames[2] = {};
+  grid front = {};
+  grid_resize (front, 200, 200);
+  for (int f = 0; f < 2; ++f)
+  {
+    grid_resize (frames[f], 200, 200);
+    grid_clear (frames[f]);
+  }
+
+  std::string row (200, 'x');
+  for (int y = 0; y < 200; ++y)
+    grid_text (frames[1], 0, y, wcolor_def ("white on red"), row.data (), row.length ());
+
+  long long full = diff_time (front, frames, true);
+  std::string out;
+  screen_diff (front, frames[0], out);
+  long long unchanged = diff_time (front, frames, false);
+  return unchanged < full;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main (int argc, char** argv)
+{
+  UnitTest t (55);
+
+  setenv ("TERM", "xterm", 1);
+  unsetenv ("COLORTERM");
+  t.is (vapi_initialize (), 0, "vapi_initialize xterm");
+  t.is (vapi_headless (WIDTH, HEIGHT), 0, "vapi_headless was off");
+  t.is (vapi_width (), WIDTH, "headless width");
+  t.is (vapi_height (), HEIGHT, "headless height");
+
+  // Text and colors arrive in the virtual terminal.
+  color red = color_def ("red");
+  vapi_pos_color_text (3, 2, red, "Hello \xe6\x97\xa5\xe6\x9c\xac");
+  vapi_refresh ();
+
+  char row[1024];
+  std::string expected = "  Hello \xe6\x97\xa5\xe6\x9c\xac" + std::string (WIDTH - 12, ' ');
+  t.is (vapi_headless_row (2, row, sizeof (row)), expected, "row 2 holds the text");
+  t.ok (vapi_headless_color (3, 2) == wcolor_from_color (red), "text has its color");
+  t.ok (vapi_headless_color (2, 2) == 0, "blank has the default color");
+
+  size_t bytes;
+  size_t sequences;
+  vapi_headless_counts (&bytes, &sequences);
+  t.is ((int) sequences, 3, "move, prologue and epilogue are counted");
+  t.ok (bytes > 16, "bytes are counted");
+
+  vapi_scroll (1, HEIGHT, 1);
+  vapi_refresh ();
+  t.is (vapi_headless_row (1, row, sizeof (row)), expected, "scrolled text moves up");
+
+  vapi_scroll (1, 1, -1);
+  vapi_refresh ();
+  t.is (vapi_headless_row (1, row, sizeof (row)), std::string (WIDTH, ' '), "scrolling one row erases it");
+
+  // The buffered renderer produces the same screens as direct drawing.
+  size_t direct_bytes;
+  size_t buffered_bytes;
+  t.is (compare (200, 1, direct_bytes, buffered_bytes), 0, "200 random frames, buffered == direct");
+
+  vapi_headless (WIDTH, HEIGHT);
+  vapi_buffered (1);
+  unsigned int seed = 7;
+  random_frame (seed);
+  vapi_refresh ();
+  vapi_headless_counts (NULL, NULL);
+  vapi_refresh ();
+  vapi_headless_counts (&bytes, &sequences);
+  t.ok (bytes == 0 && sequences == 0, "an unchanged buffered frame sends nothing");
+  vapi_buffered (0);
+  t.is (compare (200, 3, direct_bytes, buffered_bytes), 0, "200 random frames, parallel buffered == direct");
+
+  // Recorded frames play back as they were drawn, stepped or sought.
+  char path[] = "/tmp/vitapi-record-XXXXXX";
+  close (mkstemp (path));
+  std::vector <std::string> snapshots;
+  vapi_headless (WIDTH, HEIGHT);
+  t.is (vapi_record_start (path, 16), 0, "vapi_record_start");
+  seed = 1;
+  for (int f = 0; f < 100; ++f)
+  {
+    char counter[32];
+    snprintf (counter, sizeof (counter), "frame %d", f);
+    random_frame (seed);
+    vapi_pos_text (1, 1, counter);
+    vapi_refresh ();
+    snapshots.push_back (snapshot ());
+    usleep (1100);
+  }
+
+  vapi_headless_counts (&bytes, NULL);
+  t.is (vapi_record_stop (), 0, "vapi_record_stop");
+
+  struct stat info;
+  stat (path, &info);
+  t.ok ((size_t) info.st_size < bytes, "the recording is smaller than the output");
+
+  vapi_headless (WIDTH, HEIGHT);
+  t.is (vapi_play_open (path), 0, "vapi_play_open");
+  std::vector <long long> times;
+  t.is (step (snapshots, times), 100, "100 frames step back in order");
+  t.ok (vapi_play_length () == times.back (), "vapi_play_length is the time of the last frame");
+
+  int sought = 0;
+  for (size_t i = 0; i < times.size (); ++i)
+  {
+    // Frames in the same millisecond show the last of them.
+    size_t last = i;
+    while (last + 1 < times.size () && times[last + 1] == times[i])
+      ++last;
+
+    vapi_play_seek (times[i]);
+    vapi_refresh ();
+    if (snapshot () == snapshots[last])
+      ++sought;
+  }
+
+  t.is (sought, 100, "seeking to each frame time shows that frame");
+
+  vapi_play_seek (times[50]);
+  t.is (vapi_play (0), 0, "vapi_play at full speed");
+  t.is (snapshot (), snapshots.back (), "playing to the end shows the last frame");
+
+  // A recording that was cut short plays its complete frames.
+  truncate (path, info.st_size / 2);
+  t.is (vapi_play_open (path), 0, "vapi_play_open truncated recording");
+  int matched = step (snapshots, times);
+  t.ok (matched > 10 && matched < 100 && matched == (int) times.size (), "truncated recording plays its complete frames");
+  vapi_play_close ();
+  unlink (path);
+  vapi_buffered (0);
+
+  // A viewport shows a window of a file's lines, indexed on a thread.
+  char text[] = "/tmp/vitapi-view-XXXXXX";
+  FILE* file = fdopen (mkstemp (text), "w");
+  long long line_1000 = 0;
+  for (int i = 0; i < 200000; ++i)
+  {
+    if (i == 1000)
+      line_1000 = ftell (file);
+
+    if (i == 3)
+      fprintf (file, "\xe6\x97\xa5\xe6\x9c\xac wide\n");
+    else if (i == 4)
+      fprintf (file, "crlf %d\r\n", i);
+    else
+      fprintf (file, "line %d\n", i);
+  }
+
+  fclose (file);
+
+  vapi_headless (WIDTH, HEIGHT);
+  int view = vapi_view_open (text, 1, 1, WIDTH, 5);
+  t.ok (view > 0, "vapi_view_open");
+
+  int complete = 0;
+  for (int i = 0; i < 10000 && ! complete; ++i)
+  {
+    vapi_view_lines (view, &complete);
+    usleep (1000);
+  }
+
+  t.ok (vapi_view_lines (view, NULL) == 200000, "200000 lines indexed");
+  t.is (vapi_view_columns (view), 11, "vapi_view_columns is the widest line");
+
+  vapi_view_draw (view, 0);
+  vapi_refresh ();
+  expected = "line 0" + std::string (WIDTH - 6, ' ');
+  t.is (vapi_headless_row (1, row, sizeof (row)), expected, "the first line is drawn, padded");
+  expected = "\xe6\x97\xa5\xe6\x9c\xac wide" + std::string (WIDTH - 9, ' ');
+  t.is (vapi_headless_row (4, row, sizeof (row)), expected, "wide characters are measured in columns");
+  expected = "crlf 4" + std::string (WIDTH - 6, ' ');
+  t.is (vapi_headless_row (5, row, sizeof (row)), expected, "a CR before the newline is not drawn");
+
+  t.ok (vapi_view_goto (view, 150000) == 150000, "vapi_view_goto");
+  vapi_view_draw (view, 0);
+  vapi_refresh ();
+  expected = "line 150001" + std::string (WIDTH - 11, ' ');
+  t.is (vapi_headless_row (2, row, sizeof (row)), expected, "vapi_view_goto shows the line");
+
+  t.ok (vapi_view_seek (view, line_1000 + 3) == 1000, "vapi_view_seek finds the line of an offset");
+  t.ok (vapi_view_scroll (view, -1) == 999, "vapi_view_scroll up");
+  t.ok (vapi_view_goto (view, 500000) == 199999, "vapi_view_goto past the end shows the last line");
+  t.ok (vapi_view_scroll (view, 5) == 199999 && vapi_view_top (view) == 199999, "vapi_view_scroll stops at the last line");
+
+  vapi_view_left (view, 2);
+  vapi_view_draw (view, 0);
+  vapi_refresh ();
+  expected = "ne 199999" + std::string (WIDTH - 9, ' ');
+  t.is (vapi_headless_row (1, row, sizeof (row)), expected, "vapi_view_left scrolls sideways");
+  expected = std::string (WIDTH, ' ');
+  t.is (vapi_headless_row (2, row, sizeof (row)), expected, "rows past the end are blank");
+
+  vapi_view_close (view);
+  t.ok (vapi_view_lines (view, NULL) == -1, "a closed viewport is invalid");
+  t.is (vapi_view_open ("/nonexistent", 1, 1, WIDTH, 5), -1, "vapi_view_open of a missing file");
+  unlink (text);
+
+  t.ok (scan_matches (1), "line_scan on one thread matches a byte scan");
+  t.ok (scan_matches (4), "line_scan on four threads matches a byte scan");
+
+  t.ok (unchanged_is_cheap (), "an unchanged frame costs less than a full diff");
+
+  // A table fetches and draws only the visible cells that changed.
+  vapi_headless (WIDTH, HEIGHT);
+  int jobs = vapi_table_create (1, 1, 30, 6, 3, job_cell, NULL);
+  vapi_table_rows (jobs, 1000000);
+  vapi_table_title (jobs, 0, "Job");
+  vapi_table_title (jobs, 1, "Cost");
+  vapi_table_title (jobs, 2, "State");
+  vapi_table_draw (jobs);
+  vapi_refresh ();
+  expected = "Job        Cost State" + std::string (WIDTH - 21, ' ');
+  t.is (vapi_headless_row (1, row, sizeof (row)), expected, "titles, in columns as wide as sampled cells");
+  expected = "job 1      7    done" + std::string (WIDTH - 20, ' ');
+  t.is (vapi_headless_row (3, row, sizeof (row)), expected, "cells are fetched and drawn");
+  t.ok (fetched < 400, "only sampled and visible rows are fetched");
+
+  fetched = 0;
+  vapi_headless_counts (NULL, NULL);
+  vapi_table_draw (jobs);
+  vapi_refresh ();
+  vapi_headless_counts (&bytes, NULL);
+  t.ok (fetched == 0 && bytes == 0, "an unchanged table fetches and sends nothing");
+
+  state = "running";
+  vapi_table_changed (jobs, changing);
+  vapi_table_changed (jobs, 500);
+  vapi_table_draw (jobs);
+  vapi_refresh ();
+  vapi_headless_counts (&bytes, NULL);
+  t.ok (fetched == 3 && bytes < 40, "a changed row is fetched, and only its changed cell sent");
+  expected = "job 3      21   running" + std::string (WIDTH - 23, ' ');
+  t.is (vapi_headless_row (5, row, sizeof (row)), expected, "the changed cell is drawn");
+
+  t.ok (vapi_table_top (jobs, 500000) == 500000, "vapi_table_top");
+  t.ok (vapi_table_top (jobs, 2000000) == 999995, "vapi_table_top keeps the table filled");
+
+  vapi_table_width (jobs, 0, 4);
+  vapi_table_draw (jobs);
+  vapi_refresh ();
+  expected = "job  965  done" + std::string (WIDTH - 14, ' ');
+  t.is (vapi_headless_row (2, row, sizeof (row)), expected, "a fixed width clips the column");
+
+  vapi_table_destroy (jobs);
+  t.ok (vapi_table_top (jobs, 0) == -1, "a destroyed table is invalid");
+
+  t.is (vapi_headless (0, 0), 1, "vapi_headless was on");
+  vapi_deinitialize ();
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////